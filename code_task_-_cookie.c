@@ -19,7 +19,21 @@
  Compile
  =======
  Windows MSVC: cl /EHsc /Tp Cookie.C
- LLVM/GCC: g++ -std=c++20 -o Cookie Cookie.C
+ LLVM/GCC: g++ -std=c++20 -o Cookie Cookie.C (add -lrt for shm_open on glibc < 2.34)
+    add -mavx2 to use AVX2 in the CookieTableC scans
+    add -pthread for --replay on glibc < 2.34
+    public_suffix_list.inc (the built-in Public Suffix List) must sit next
+    to the source; regenerate it from a newer public_suffix_list.dat with
+    gen_public_suffix_list.py or load one at run time with
+    PublicSuffixListC::LoadFile
+
+ Replay
+ ======
+ Cookie --replay <har or header dump> [--threads N] [--rate OPS_PER_SEC] [--iterations N]
+
+ Self test
+ =========
+ Cookie --selftest    exit code 0 when all checks pass
 
  */
 
@@ -29,6 +43,32 @@
 #include <string>
 #include <cstring>
 #include <cassert>
+#include <cctype>
+#include <cstdio>
+#include <cerrno>
+#include <cstdint>
+#include <atomic>
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <map>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
 
 static void Free(void *ptr)
 {
@@ -73,6 +113,19 @@ bool StrCaseEq(const char *Str1, const char *Str2)
 #endif
 }
 
+//64-bit FNV-1a, chain calls by passing the previous result as Hash
+static uint64_t HashBytes(const void *Data, size_t Len, uint64_t Hash = 14695981039346656037ULL)
+{
+   const unsigned char *Ptr = (const unsigned char *) Data;
+
+   while (Len--)
+   {
+      Hash ^= *Ptr++;
+      Hash *= 1099511628211ULL;
+   }
+   return Hash;
+}
+
 //align Windows with other platforms
 #ifdef _WIN32
 #define strtok_r strtok_s
@@ -84,8 +137,37 @@ struct tm *gmtime_r(const time_t *clock, struct tm *res)
       return nullptr;
    return res;
 }
+
+#define timegm _mkgmtime
+
+struct iovec
+{
+   void  *iov_base;
+   size_t iov_len;
+};
 #endif
 
+enum CookieParseResultE
+{
+   COOKIE_PARSE_OK = 0,
+   COOKIE_PARSE_NO_NAME,
+   COOKIE_PARSE_HEADER_TOO_LONG,
+   COOKIE_PARSE_TOO_MANY_ATTRIBUTES,
+   COOKIE_PARSE_NAME_TOO_LONG,
+   COOKIE_PARSE_VALUE_TOO_LONG,
+   COOKIE_PARSE_BAD_MAX_AGE,
+   COOKIE_PARSE_NO_MEMORY
+};
+
+// Caps for CookieC::FromString on untrusted input
+struct CookieParseLimitsS
+{
+   size_t MaxHeaderLength = 8192;
+   int    MaxAttributes   = 32;   // including the name/value pair
+   size_t MaxNameLength   = 256;  // cookie name
+   size_t MaxValueLength  = 4096; // cookie value and attribute values
+};
+
 class CookieC
 {
  public:
@@ -107,15 +189,30 @@ class CookieC
    const char *GetDomain() const;
    const char *GetPath() const;
    const char *GetExpires() const;
+   time_t      GetExpiresTime() const;
    const char *GetSameSite() const;
    bool        IsSecure() const;
    bool        IsHttpOnly() const;
    bool        IsSessionCookie() const;
 
    bool        FromString(const char *Str, const char *Domain = nullptr);
+   bool        FromString(const char               *Str,
+                          const char               *Domain,
+                          const CookieParseLimitsS &Limits,
+                          CookieParseResultE       *Result = nullptr);
    const char *ToString() const;
+   size_t      ToStringLength() const;
+
+   static size_t ToSetCookieIovec(const CookieC *const *Cookies,
+                                  size_t                Count,
+                                  struct iovec         *Iov,
+                                  size_t                MaxIov,
+                                  size_t               *Consumed = nullptr);
 
  private:
+   friend class SharedCookieStoreC;
+   friend class CookieJarC;
+
    bool Init(const char *Name,
              const char *Value,
              const char *Domain,
@@ -126,6 +223,9 @@ class CookieC
 
    void Assign(const CookieC &rhs);
    void Free();
+   bool Parse(const char *Str, const char *Domain, const CookieParseLimitsS *Limits, CookieParseResultE *Result);
+
+   static bool ParseMaxAge(const char *Value, int64_t *Seconds);
 
    void SetName(const char *Name);
    void SetValue(const char *Value);
@@ -138,12 +238,34 @@ class CookieC
    void SetHttpOnly(bool HttpOnly);
    void SetSameSite(const char *SameSite);
 
-   char         *mName, *mValue, *mDomain, *mPath, *mExpires;
-   mutable char *mHeaderFormat;
-   bool          mSecure, mHttpOnly;
-   char         *mSameSite;
+   char           *mName, *mValue, *mDomain, *mPath, *mExpires;
+   mutable char   *mHeaderFormat;
+   mutable size_t  mHeaderFormatLen;
+   bool            mSecure, mHttpOnly;
+   char           *mSameSite;
 };
 
+/*=****************************************************************************
+**
+** void FreeArgCV(char **ItemList, int NoOfItems)
+**
+** DESCRIPTION : Free an item list returned by SplitStringIntoItems
+**
+** RETURN VALUE:
+**                                                                           */
+/*=***************************************************************************/
+void FreeArgCV(char **ItemList, int NoOfItems)
+{
+   int i;
+
+   if (!ItemList)
+      return;
+
+   for (i = 0; i < NoOfItems; i++)
+      Free(ItemList[i]);
+   Free(ItemList);
+}
+
 /*=****************************************************************************
 **
 ** int SplitStringIntoItems(const char *Str, char ***ItemListPtr, const char
@@ -154,11 +276,15 @@ class CookieC
 **    Returned itemlist and each item  must be Free(F)'d by caller,
 **    use FreeArgCV(F)
 **
+**    With <ItemLimit> > 0 the split stops as soon as there are more items
+**    than that, so hostile input cannot grow the list without bound.
+**
 ** RETURN VALUE: no of items, items returned in ItemListPtr
+**    -1 on allocation failure, -2 when <ItemLimit> is exceeded
 **    REMEMBER TO Free(F) or FreeArgCV(F)
 **                                                                           */
 /*=***************************************************************************/
-int SplitStringIntoItems(const char *Str, char ***ItemListPtr, const char *SepStr)
+int SplitStringIntoItems(const char *Str, char ***ItemListPtr, const char *SepStr, int ItemLimit = 0)
 {
    char **ItemList = NULL;
    char  *TmpStr;
@@ -186,15 +312,25 @@ int SplitStringIntoItems(const char *Str, char ***ItemListPtr, const char *SepSt
          ItemPtr = strtok_r(TmpStr, SepStr, &Nxt);
          while (ItemPtr != NULL)
          {
+            if (ItemLimit > 0 && NoOfItems == ItemLimit)
+            {
+               FreeArgCV(ItemList, NoOfItems);
+               *ItemListPtr = NULL;
+               Free(TmpStr);
+               return -2;
+            }
+
             if (NoOfItems == MaxNoOfItems)
             {
-               ItemList = (char **) realloc(ItemList, (MaxNoOfItems + 20) * sizeof(char *));
-               if (!ItemList)
+               char **NewList = (char **) realloc(ItemList, (MaxNoOfItems + 20) * sizeof(char *));
+               if (!NewList)
                {
+                  FreeArgCV(ItemList, NoOfItems);
                   *ItemListPtr = NULL;
                   Free(TmpStr);
                   return -1;
                }
+               ItemList = NewList;
                MaxNoOfItems += 20;
             }
 
@@ -268,6 +404,7 @@ CookieC::CookieC() :
    mPath(nullptr),
    mExpires(nullptr),
    mHeaderFormat(nullptr),
+   mHeaderFormatLen(0),
    mSecure(false),
    mHttpOnly(false),
    mSameSite(nullptr)
@@ -319,15 +456,16 @@ bool CookieC::Init(const char *Name,
 /*=***************************************************************************/
 void CookieC::Assign(const CookieC &rhs)
 {
-   mName         = Strdup(rhs.mName);
-   mValue        = Strdup(rhs.mValue);
-   mDomain       = Strdup(rhs.mDomain);
-   mPath         = Strdup(rhs.mPath);
-   mExpires      = Strdup(rhs.mExpires);
-   mHeaderFormat = Strdup(rhs.mHeaderFormat);
-   mSecure       = rhs.mSecure;
-   mHttpOnly     = rhs.mHttpOnly;
-   mSameSite     = Strdup(rhs.mSameSite);
+   mName            = Strdup(rhs.mName);
+   mValue           = Strdup(rhs.mValue);
+   mDomain          = Strdup(rhs.mDomain);
+   mPath            = Strdup(rhs.mPath);
+   mExpires         = Strdup(rhs.mExpires);
+   mHeaderFormat    = Strdup(rhs.mHeaderFormat);
+   mHeaderFormatLen = rhs.mHeaderFormatLen;
+   mSecure          = rhs.mSecure;
+   mHttpOnly        = rhs.mHttpOnly;
+   mSameSite        = Strdup(rhs.mSameSite);
 }
 
 /*=****************************************************************************
@@ -408,7 +546,10 @@ CookieC::~CookieC()
 /*=***************************************************************************/
 void CookieC::SetName(const char *Name)
 {
+   char *Old = mName;
+
    mName = Strdup(Name);
+   ::Free(Old);
 }
 
 /*=****************************************************************************
@@ -436,7 +577,10 @@ const char *CookieC::GetName() const
 /*=***************************************************************************/
 void CookieC::SetValue(const char *Value)
 {
+   char *Old = mValue;
+
    mValue = Strdup(Value);
+   ::Free(Old);
 }
 
 /*=****************************************************************************
@@ -464,6 +608,8 @@ const char *CookieC::GetValue() const
 /*=***************************************************************************/
 void CookieC::SetDomain(const char *Domain)
 {
+   char *Old = mDomain;
+
    if (strstr(Domain, "#HttpOnly_"))
    {
       mDomain   = Strdup(Domain + 10);
@@ -473,6 +619,7 @@ void CookieC::SetDomain(const char *Domain)
    {
       mDomain = Strdup(Domain);
    }
+   ::Free(Old);
 }
 
 /*=****************************************************************************
@@ -501,7 +648,12 @@ const char *CookieC::GetDomain() const
 void CookieC::SetPath(const char *Path)
 {
    if (strcmp(Path, "unknown") != 0)
+   {
+      char *Old = mPath;
+
       mPath = Strdup(Path);
+      ::Free(Old);
+   }
 }
 
 /*=****************************************************************************
@@ -553,6 +705,7 @@ void CookieC::SetExpires(time_t Expires)
       memcpy(TmpExpires, DAYS[Tm.tm_wday], 3);
       memcpy(TmpExpires + 3 + 1 + 1 + 2 + 1, MONS[Tm.tm_mon], 3);
 
+      ::Free(mExpires);
       mExpires = Strdup(TmpExpires);
    }
 }
@@ -587,6 +740,47 @@ const char *CookieC::GetExpires() const
    return mExpires;
 }
 
+/*=****************************************************************************
+**
+** time_t CookieC::GetExpiresTime() const
+**
+** DESCRIPTION : Expires as a time_t. Accepts the RFC1123 format written by
+**    SetExpires(time_t) and the older "dd-Mon-yyyy" variant.
+**
+** RETURN VALUE: expiry time, 0 for session cookies or unparsable dates
+**                                                                           */
+/*=***************************************************************************/
+time_t CookieC::GetExpiresTime() const
+{
+   const char MONS[12][3 + 1] =
+      {"Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
+   char      Mon[3 + 1];
+   struct tm Tm;
+   int       i;
+
+   if (IsEmptyString(mExpires))
+      return 0;
+
+   memset(&Tm, 0, sizeof(Tm));
+   if (sscanf(mExpires, "%*[^,], %d %3s %d %d:%d:%d", &Tm.tm_mday, Mon, &Tm.tm_year, &Tm.tm_hour, &Tm.tm_min,
+              &Tm.tm_sec) != 6 &&
+       sscanf(mExpires, "%*[^,], %d-%3s-%d %d:%d:%d", &Tm.tm_mday, Mon, &Tm.tm_year, &Tm.tm_hour, &Tm.tm_min,
+              &Tm.tm_sec) != 6)
+      return 0;
+
+   for (i = 0; i < 12 && !StrCaseEq(Mon, MONS[i]); i++)
+      ;
+   if (i == 12)
+      return 0;
+
+   Tm.tm_mon = i;
+   if (Tm.tm_year < 100)
+      Tm.tm_year += (Tm.tm_year < 70) ? 2000 : 1900;
+   Tm.tm_year -= 1900;
+
+   return timegm(&Tm);
+}
+
 /*=****************************************************************************
 **
 ** void CookieC::SetSecure(const char *Secure)
@@ -675,7 +869,10 @@ bool CookieC::IsSessionCookie() const
 /*=***************************************************************************/
 void CookieC::SetSameSite(const char *SameSite)
 {
+   char *Old = mSameSite;
+
    mSameSite = Strdup(SameSite);
+   ::Free(Old);
 }
 
 /*=****************************************************************************
@@ -709,40 +906,164 @@ const char *CookieC::GetSameSite() const
 /*=***************************************************************************/
 bool CookieC::FromString(const char *CookieStr, const char *Domain)
 {
-   bool        IsNameSet  = false;
-   char      **Parameters = nullptr;
-   int         Count;
-   int         i;
-   char       *Name;
-   char       *Delim;
-   const char *Value;
+   return Parse(CookieStr, Domain, nullptr, nullptr);
+}
+
+/*=****************************************************************************
+**
+** bool CookieC::FromString(const char *CookieStr, const char *Domain, const
+**    CookieParseLimitsS &Limits, CookieParseResultE *Result)
+**
+** DESCRIPTION : As FromString above, for untrusted input. Rejects headers,
+**    attribute counts, names and values over <Limits> and Max-Age values
+**    that are not an optionally negative decimal integer, so the work per
+**    header is linear and bounded by MaxHeaderLength.
+**
+**    Max-Age <= 0 sets an expiry in the past (the cookie is deleted) and
+**    Max-Age is capped at 400 days, as in RFC 6265bis.
+**
+**    On failure the cookie may be partly set and must be discarded.
+**
+** RETURN VALUE: false on failure, <Result> tells why
+**                                                                           */
+/*=***************************************************************************/
+bool CookieC::FromString(const char               *CookieStr,
+                         const char               *Domain,
+                         const CookieParseLimitsS &Limits,
+                         CookieParseResultE       *Result)
+{
+   return Parse(CookieStr, Domain, &Limits, Result);
+}
+
+/*=****************************************************************************
+**
+** bool CookieC::ParseMaxAge(const char *Value, int64_t *Seconds)
+**
+** DESCRIPTION : Strict Max-Age parsing: an optional '-' followed by decimal
+**    digits only, overflow checked. Spaces and tabs around the number are
+**    ignored, as in RFC 6265 5.2.
+**
+** RETURN VALUE:
+**                                                                           */
+/*=***************************************************************************/
+bool CookieC::ParseMaxAge(const char *Value, int64_t *Seconds)
+{
+   const char *End;
+   bool        Negative;
+   int64_t     Result = 0;
+
+   while (*Value == ' ' || *Value == '\t')
+      Value++;
+   for (End = Value + strlen(Value); End > Value && (End[-1] == ' ' || End[-1] == '\t'); End--)
+      ;
+
+   Negative = (*Value == '-');
+   if (Negative)
+      Value++;
+   if (Value == End)
+      return false;
+
+   for (; Value < End; Value++)
+   {
+      if (*Value < '0' || *Value > '9')
+         return false;
+      if (Result > (INT64_MAX - (*Value - '0')) / 10)
+         return false;
+      Result = Result * 10 + (*Value - '0');
+   }
+
+   *Seconds = Negative ? -Result : Result;
+   return true;
+}
+
+/*=****************************************************************************
+**
+** bool CookieC::Parse(const char *CookieStr, const char *Domain, const
+**    CookieParseLimitsS *Limits, CookieParseResultE *Result)
+**
+** DESCRIPTION : Common part of the FromString variants. <Limits> is
+**    nullptr for the lenient parser.
+**
+** RETURN VALUE:
+**                                                                           */
+/*=***************************************************************************/
+bool CookieC::Parse(const char *CookieStr, const char *Domain, const CookieParseLimitsS *Limits,
+                    CookieParseResultE *Result)
+{
+   const int64_t      MAX_AGE_CAP = 400 * 24 * 60 * 60;
+   bool               IsNameSet   = false;
+   char             **Parameters  = nullptr;
+   CookieParseResultE Status      = COOKIE_PARSE_OK;
+   int                Count;
+   int                i;
+   char              *Name;
+   char              *Delim;
+   const char        *Value;
+   size_t             NameLen;
+   int64_t            MaxAge;
+
+   // drop the cached header, it is about to go stale
+   ::Free(mHeaderFormat);
+   mHeaderFormat    = nullptr;
+   mHeaderFormatLen = 0;
+
+   if (Limits && CookieStr && strnlen(CookieStr, Limits->MaxHeaderLength + 1) > Limits->MaxHeaderLength)
+   {
+      if (Result)
+         *Result = COOKIE_PARSE_HEADER_TOO_LONG;
+      return false;
+   }
 
    if (Domain)
       SetDomain(Domain);
 
-   Count = SplitStringIntoItems(CookieStr, &Parameters, ";");
-   for (i = 0; i < Count; i++)
+   Count = SplitStringIntoItems(CookieStr, &Parameters, ";", Limits ? Limits->MaxAttributes : 0);
+   if (Count < 0)
+      Status = (Count == -2) ? COOKIE_PARSE_TOO_MANY_ATTRIBUTES : COOKIE_PARSE_NO_MEMORY;
+
+   for (i = 0; i < Count && Status == COOKIE_PARSE_OK; i++)
    {
       Name  = TrimSpaces(Parameters[i]);
       Delim = strchr(Name, '=');
       if (Delim)
       {
-         *Delim = 0; /* Terminate Name                            */
-         Value  = Delim + 1;
+         *Delim  = 0; /* Terminate Name                            */
+         Value   = Delim + 1;
+         NameLen = Delim - Name;
       }
       else
-         Value = "";
+      {
+         Value   = "";
+         NameLen = strlen(Name);
+      }
       if (*Name == 0)
          continue;
 
+      if (Limits && strnlen(Value, Limits->MaxValueLength + 1) > Limits->MaxValueLength)
+      {
+         Status = COOKIE_PARSE_VALUE_TOO_LONG;
+         break;
+      }
+
       if (!IsNameSet)
       {
          /* First parameter must be Name/Value */
-         if (Name[0] == '"' && Name[strlen(Name) - 1] == '"')
+         if (NameLen > 1 && Name[0] == '"' && Name[NameLen - 1] == '"')
          {
             /* Name may be surrounded by double quotes */
-            Name[strlen(Name) - 1] = 0;
+            Name[NameLen - 1] = 0;
             Name++;
+            NameLen -= 2;
+         }
+         if (NameLen == 0) /* e.g. ""=value */
+         {
+            Status = COOKIE_PARSE_NO_NAME;
+            break;
+         }
+         if (Limits && NameLen > Limits->MaxNameLength)
+         {
+            Status = COOKIE_PARSE_NAME_TOO_LONG;
+            break;
          }
          SetName(Name);
          SetValue(Value);
@@ -767,7 +1088,16 @@ bool CookieC::FromString(const char *CookieStr, const char *Domain)
          case 'M':
             if (StrCaseEq(Name, "Max-Age"))
             {
-               if (atoi(Value) > 0)
+               if (Limits)
+               {
+                  if (!ParseMaxAge(Value, &MaxAge))
+                     Status = COOKIE_PARSE_BAD_MAX_AGE;
+                  else if (MaxAge <= 0)
+                     SetExpires((time_t) 1); /* earliest representable time, deletes the cookie */
+                  else
+                     SetExpires(time(nullptr) + (time_t) std::min(MaxAge, MAX_AGE_CAP));
+               }
+               else if (atoi(Value) > 0)
                {
                   /* Max-Age is # seconds from now. So expiration will be <Now> +
                      Value                                                      */
@@ -792,8 +1122,13 @@ bool CookieC::FromString(const char *CookieStr, const char *Domain)
       }
    }
 
-   ::Free(Parameters);
-   return IsNameSet;
+   FreeArgCV(Parameters, Count);
+
+   if (Status == COOKIE_PARSE_OK && !IsNameSet)
+      Status = COOKIE_PARSE_NO_NAME;
+   if (Result)
+      *Result = Status;
+   return (Status == COOKIE_PARSE_OK);
 }
 
 /*=****************************************************************************
@@ -815,6 +1150,7 @@ const char *CookieC::ToString() const
    if (!mHeaderFormat)
    {
       std::ostringstream oss;
+      std::string        Header;
 
       oss << mName << "=" << mValue;
 
@@ -833,17 +1169,4484 @@ const char *CookieC::ToString() const
       if (mHttpOnly)
          oss << "; httponly";
 
-      mHeaderFormat = Strdup(oss.str().c_str());
+      Header           = std::move(oss).str();
+      mHeaderFormat    = Strdup(Header.c_str());
+      mHeaderFormatLen = mHeaderFormat ? Header.size() : 0;
    }
 
    return mHeaderFormat;
 }
 
+/*=****************************************************************************
+**
+** size_t CookieC::ToStringLength() const
+**
+** DESCRIPTION : Length of the ToString() result, without a strlen
+**
+** RETURN VALUE:
+**                                                                           */
+/*=***************************************************************************/
+size_t CookieC::ToStringLength() const
+{
+   ToString();
+   return mHeaderFormatLen;
+}
+
+/*=****************************************************************************
+**
+** size_t CookieC::ToSetCookieIovec(const CookieC *const *Cookies, size_t
+**    Count, struct iovec *Iov, size_t MaxIov, size_t *Consumed)
+**
+** DESCRIPTION : Describe "Set-Cookie: <cookie>\r\n" for each of <Cookies>
+**    in <Iov>, ready for writev/sendmsg. Each cookie takes 3 entries that
+**    point at its cached ToString() bytes and at shared constant
+**    separators, so nothing is copied or allocated once the cookies have
+**    been serialized. Only whole cookies are emitted; if <MaxIov> is too
+**    small, call again with the cookies after the first <*Consumed>.
+**    Cookies that cannot be serialized (ToString() fails) are skipped but
+**    still counted as consumed.
+**
+**    The entries stay valid until a cookie is changed or deleted.
+**
+** RETURN VALUE: number of iovec entries filled (3 per emitted cookie)
+**                                                                           */
+/*=***************************************************************************/
+size_t CookieC::ToSetCookieIovec(const CookieC *const *Cookies,
+                                 size_t                Count,
+                                 struct iovec         *Iov,
+                                 size_t                MaxIov,
+                                 size_t               *Consumed)
+{
+   static const char SET_COOKIE[] = "Set-Cookie: ";
+   static const char CRLF[]       = "\r\n";
+   size_t            Used         = 0;
+   size_t            i;
 
+   for (i = 0; i < Count && Used + 3 <= MaxIov; i++)
+   {
+      const char *Header = Cookies[i]->ToString();
 
+      if (!Header)
+         continue;
 
-int main(int argc, char* argv[])
+      Iov[Used].iov_base  = (void *) SET_COOKIE;
+      Iov[Used++].iov_len = sizeof(SET_COOKIE) - 1;
+      Iov[Used].iov_base  = (void *) Header;
+      Iov[Used++].iov_len = Cookies[i]->mHeaderFormatLen;
+      Iov[Used].iov_base  = (void *) CRLF;
+      Iov[Used++].iov_len = sizeof(CRLF) - 1;
+   }
+
+   if (Consumed)
+      *Consumed = i;
+   return Used;
+}
+
+
+/*=****************************************************************************
+**
+** struct CookieJarLimitsS
+**
+** DESCRIPTION : Capacity limits of a CookieJarC. Defaults are the RFC 6265
+**    section 6.1 minimums.
+**                                                                           */
+/*=***************************************************************************/
+struct CookieJarLimitsS
+{
+   size_t MaxCookiesPerDomain = 50;
+   size_t MaxCookies          = 3000;
+   size_t MaxCookieSize       = 4096; // strlen(name) + strlen(value)
+};
+
+/*=****************************************************************************
+**
+** class PublicSuffixListC
+**
+** DESCRIPTION : Public Suffix List matcher (https://publicsuffix.org).
+**
+**    Rules are stored as a DAFSA over reversed labels: a trie whose
+**    identical subtrees are merged, flattened into a node array, an edge
+**    array sorted by label within each node, and a pool of unique labels.
+**    A lookup makes one right-to-left pass over the host's labels with a
+**    binary search per label and does not allocate.
+**
+**    Default() holds the full list compiled in from public_suffix_list.inc.
+**    Load a newer public_suffix_list.dat with LoadFile(); loading is not
+**    safe while other threads are matching against the same object.
+**    Internationalized rules are converted to punycode when loaded, so they
+**    match hosts in the "xn--" form used on the wire.
+**
+**    IP literals ("192.168.0.1", "::1", "[::1]") have no public suffix;
+**    RegistrableDomain() returns them whole.
+**                                                                           */
+/*=***************************************************************************/
+class PublicSuffixListC
+{
+ public:
+   PublicSuffixListC();
+
+   static const PublicSuffixListC &Default();
+
+   bool        LoadString(const char *Rules);
+   bool        LoadFile(const char *FileName);
+   const char *RegistrableDomain(const char *Host) const;
+   bool        IsPublicSuffix(const char *Host) const;
+   size_t      NodeCount() const;
+
+   static bool IsIpLiteral(const char *Host);
+
+ private:
+   enum
+   {
+      NODE_RULE      = 0x01, // a rule ends at this node
+      NODE_EXCEPTION = 0x02  // "!" rule: the parent is the public suffix
+   };
+
+   struct NodeS
+   {
+      uint32_t FirstEdge;
+      uint32_t EdgeCount;
+      uint8_t  Flags;
+   };
+
+   struct EdgeS
+   {
+      uint32_t LabelOffset;
+      uint32_t LabelLen;
+      uint32_t Target;
+   };
+
+   struct BuildNodeS
+   {
+      std::map<std::string, BuildNodeS> Children;
+      uint8_t                           Flags = 0;
+   };
+
+   uint32_t     Emit(const BuildNodeS &Node, std::unordered_map<std::string, uint32_t> &Signatures,
+                     std::unordered_map<std::string, uint32_t> &Labels);
+   const EdgeS *FindEdge(uint32_t Node, const char *Label, size_t Len) const;
+   const char  *FindSuffix(const char *Host, bool *IsExplicit) const;
+
+   static bool     ToPunycode(const char *Start, const char *End, std::string &Label);
+   static uint32_t PunycodeBias(uint64_t Delta, uint64_t Points, bool First);
+
+   std::vector<NodeS> mNodes;
+   std::vector<EdgeS> mEdges;
+   std::string        mLabels;
+   uint32_t           mRoot;
+};
+
+// Snapshot of public_suffix_list.dat, one rule per entry (an array rather
+// than one literal, which would exceed compiler string length limits)
+static const char *const DEFAULT_PUBLIC_SUFFIXES[] = {
+#include "public_suffix_list.inc"
+};
+
+/*=****************************************************************************
+**
+** PublicSuffixListC::PublicSuffixListC()
+**
+** DESCRIPTION : Constructor, empty list (only the implicit "*" rule)
+**
+** RETURN VALUE:
+**                                                                           */
+/*=***************************************************************************/
+PublicSuffixListC::PublicSuffixListC() :
+   mRoot(0)
+{
+   LoadString("");
+}
+
+/*=****************************************************************************
+**
+** const PublicSuffixListC &PublicSuffixListC::Default()
+**
+** DESCRIPTION : Shared list built from DEFAULT_PUBLIC_SUFFIXES on first use
+**
+** RETURN VALUE:
+**                                                                           */
+/*=***************************************************************************/
+const PublicSuffixListC &PublicSuffixListC::Default()
+{
+   static const PublicSuffixListC *List = []() {
+      PublicSuffixListC *L = new PublicSuffixListC();
+      std::string        Rules;
+
+      for (const char *Rule : DEFAULT_PUBLIC_SUFFIXES)
+         Rules.append(Rule).push_back('\n');
+      L->LoadString(Rules.c_str());
+      return L;
+   }();
+
+   return *List;
+}
+
+/*=****************************************************************************
+**
+** uint32_t PublicSuffixListC::Emit(const BuildNodeS &Node,
+**    std::unordered_map<std::string, uint32_t> &Signatures,
+**    std::unordered_map<std::string, uint32_t> &Labels)
+**
+** DESCRIPTION : Flatten the subtree at <Node> bottom-up, reusing an
+**    already emitted node with the same flags and edges
+**
+** RETURN VALUE: node index
+**                                                                           */
+/*=***************************************************************************/
+uint32_t PublicSuffixListC::Emit(const BuildNodeS &Node, std::unordered_map<std::string, uint32_t> &Signatures,
+                                 std::unordered_map<std::string, uint32_t> &Labels)
+{
+   std::vector<uint32_t> Targets;
+   std::string           Signature(1, (char) Node.Flags);
+   NodeS                 Flat;
+
+   for (auto &Child : Node.Children)
+   {
+      uint32_t Target = Emit(Child.second, Signatures, Labels);
+
+      Targets.push_back(Target);
+      Signature.append(Child.first).push_back('\0');
+      Signature.append((const char *) &Target, sizeof(Target));
+   }
+
+   auto Found = Signatures.find(Signature);
+   if (Found != Signatures.end())
+      return Found->second;
+
+   Flat.FirstEdge = (uint32_t) mEdges.size();
+   Flat.EdgeCount = (uint32_t) Targets.size();
+   Flat.Flags     = Node.Flags;
+
+   size_t i = 0;
+   for (auto &Child : Node.Children)
+   {
+      auto  Label = Labels.try_emplace(Child.first, (uint32_t) mLabels.size());
+      EdgeS Edge;
+
+      if (Label.second)
+         mLabels.append(Child.first);
+
+      Edge.LabelOffset = Label.first->second;
+      Edge.LabelLen    = (uint32_t) Child.first.size();
+      Edge.Target      = Targets[i++];
+      mEdges.push_back(Edge);
+   }
+
+   mNodes.push_back(Flat);
+   Signatures.emplace(Signature, (uint32_t) mNodes.size() - 1);
+   return (uint32_t) mNodes.size() - 1;
+}
+
+/*=****************************************************************************
+**
+** bool PublicSuffixListC::LoadString(const char *Rules)
+**
+** DESCRIPTION : Replace the rules with <Rules> in public_suffix_list.dat
+**    format: one rule per line, "//" comments, "*." wildcard and "!"
+**    exception rules. UTF-8 labels are stored in punycode; rules that are
+**    not valid UTF-8 are skipped.
+**
+** RETURN VALUE: false if <Rules> is nullptr
+**                                                                           */
+/*=***************************************************************************/
+bool PublicSuffixListC::LoadString(const char *Rules)
 {
+   BuildNodeS                                Root;
+   std::unordered_map<std::string, uint32_t> Signatures;
+   std::unordered_map<std::string, uint32_t> Labels;
+   const char                               *Line;
+   const char                               *End;
+
+   if (!Rules)
+      return false;
+
+   for (Line = Rules; *Line; Line = *End ? End + 1 : End)
+   {
+      const char              *RuleEnd;
+      BuildNodeS              *Node  = &Root;
+      uint8_t                  Flags = NODE_RULE;
+      std::vector<std::string> RuleLabels;
+
+      End = strchr(Line, '\n');
+      if (!End)
+         End = Line + strlen(Line);
+
+      // the rule is the first whitespace delimited word of the line
+      while (Line < End && (*Line == ' ' || *Line == '\t'))
+         Line++;
+      for (RuleEnd = Line; RuleEnd < End && !isspace((unsigned char) *RuleEnd); RuleEnd++)
+         ;
+      if (RuleEnd == Line || (RuleEnd - Line >= 2 && Line[0] == '/' && Line[1] == '/'))
+         continue;
+
+      if (*Line == '!')
+      {
+         Flags = NODE_EXCEPTION;
+         Line++;
+      }
+
+      // split into labels right to left
+      while (RuleEnd > Line)
+      {
+         const char *LabelStart = RuleEnd;
+         std::string Label;
+
+         while (LabelStart > Line && LabelStart[-1] != '.')
+            LabelStart--;
+         if (!ToPunycode(LabelStart, RuleEnd, Label))
+            break;
+
+         RuleLabels.push_back(Label);
+         RuleEnd = (LabelStart > Line) ? LabelStart - 1 : Line;
+      }
+      if (RuleEnd > Line)
+         continue;
+
+      for (const std::string &Label : RuleLabels)
+         Node = &Node->Children[Label];
+      Node->Flags |= Flags;
+   }
+
+   mNodes.clear();
+   mEdges.clear();
+   mLabels.clear();
+   mRoot = Emit(Root, Signatures, Labels);
+
+   mNodes.shrink_to_fit();
+   mEdges.shrink_to_fit();
+   mLabels.shrink_to_fit();
+   return true;
+}
+
+/*=****************************************************************************
+**
+** bool PublicSuffixListC::ToPunycode(const char *Start, const char *End,
+**    std::string &Label)
+**
+** DESCRIPTION : Lowercase the label from <Start> to <End>; if it is not
+**    ASCII, decode it as UTF-8 and encode it as an RFC 3492 punycode
+**    "xn--" label. Non-ASCII characters are taken as they are, without
+**    Unicode case mapping or normalization (the list is already in that
+**    form).
+**
+** RETURN VALUE: false if the label is not valid UTF-8
+**                                                                           */
+/*=***************************************************************************/
+bool PublicSuffixListC::ToPunycode(const char *Start, const char *End, std::string &Label)
+{
+   const uint32_t        BASE = 36, TMIN = 1, TMAX = 26;
+   std::vector<uint32_t> CodePoints;
+   const unsigned char  *Ptr;
+   uint32_t              N     = 0x80;
+   uint32_t              Bias  = 72;
+   uint64_t              Delta = 0;
+   size_t                Basic = 0;
+   size_t                Handled;
+
+   Label.clear();
+   for (Ptr = (const unsigned char *) Start; Ptr < (const unsigned char *) End; Ptr++)
+      Label.push_back((char) tolower(*Ptr));
+   if (std::all_of(Label.begin(), Label.end(), [](char Chr) { return (unsigned char) Chr < 0x80; }))
+      return true;
+
+   for (Ptr = (const unsigned char *) Label.data(); Ptr < (const unsigned char *) Label.data() + Label.size();)
+   {
+      size_t   Left = (const unsigned char *) Label.data() + Label.size() - Ptr;
+      size_t   Len;
+      uint32_t CodePoint;
+
+      if (*Ptr < 0x80)
+         Len = 1, CodePoint = *Ptr;
+      else if ((*Ptr & 0xe0) == 0xc0)
+         Len = 2, CodePoint = *Ptr & 0x1f;
+      else if ((*Ptr & 0xf0) == 0xe0)
+         Len = 3, CodePoint = *Ptr & 0x0f;
+      else if ((*Ptr & 0xf8) == 0xf0)
+         Len = 4, CodePoint = *Ptr & 0x07;
+      else
+         return false;
+      if (Len > Left)
+         return false;
+      for (size_t i = 1; i < Len; i++)
+      {
+         if ((Ptr[i] & 0xc0) != 0x80)
+            return false;
+         CodePoint = (CodePoint << 6) | (Ptr[i] & 0x3f);
+      }
+      if ((Len == 2 && CodePoint < 0x80) || (Len == 3 && CodePoint < 0x800) || (Len == 4 && CodePoint < 0x10000) ||
+          CodePoint > 0x10ffff || (CodePoint >= 0xd800 && CodePoint <= 0xdfff))
+         return false;
+
+      CodePoints.push_back(CodePoint);
+      Ptr += Len;
+   }
+
+   Label = "xn--";
+   for (uint32_t CodePoint : CodePoints)
+   {
+      if (CodePoint < 0x80)
+      {
+         Label.push_back((char) CodePoint);
+         Basic++;
+      }
+   }
+   if (Basic)
+      Label.push_back('-');
+
+   for (Handled = Basic; Handled < CodePoints.size(); N++)
+   {
+      uint32_t Next = UINT32_MAX;
+
+      for (uint32_t CodePoint : CodePoints)
+      {
+         if (CodePoint >= N && CodePoint < Next)
+            Next = CodePoint;
+      }
+      Delta += (uint64_t) (Next - N) * (Handled + 1);
+      N      = Next;
+
+      for (uint32_t CodePoint : CodePoints)
+      {
+         if (CodePoint < N)
+            Delta++;
+         if (CodePoint != N)
+            continue;
+
+         // variable-length integer of Delta, generalized base 36
+         uint64_t Q = Delta;
+         for (uint32_t K = BASE;; K += BASE)
+         {
+            uint32_t T     = (K <= Bias) ? TMIN : (K >= Bias + TMAX) ? TMAX : K - Bias;
+            uint32_t Digit;
+
+            if (Q < T)
+               break;
+            Digit = T + (uint32_t) ((Q - T) % (BASE - T));
+            Label.push_back((char) (Digit < 26 ? 'a' + Digit : '0' + Digit - 26));
+            Q = (Q - T) / (BASE - T);
+         }
+         Label.push_back((char) (Q < 26 ? 'a' + Q : '0' + Q - 26));
+
+         Bias  = PunycodeBias(Delta, Handled + 1, Handled == Basic);
+         Delta = 0;
+         Handled++;
+      }
+      Delta++;
+   }
+   return true;
+}
+
+/*=****************************************************************************
+**
+** uint32_t PublicSuffixListC::PunycodeBias(uint64_t Delta, uint64_t
+**    Points, bool First)
+**
+** DESCRIPTION : RFC 3492 6.1 bias adaptation
+**
+** RETURN VALUE: new bias
+**                                                                           */
+/*=***************************************************************************/
+uint32_t PublicSuffixListC::PunycodeBias(uint64_t Delta, uint64_t Points, bool First)
+{
+   uint32_t K = 0;
+
+   Delta  = First ? Delta / 700 : Delta / 2;
+   Delta += Delta / Points;
+   while (Delta > ((36 - 1) * 26) / 2)
+   {
+      Delta /= 36 - 1;
+      K     += 36;
+   }
+   return K + (uint32_t) ((36 * Delta) / (Delta + 38));
+}
+
+/*=****************************************************************************
+**
+** bool PublicSuffixListC::LoadFile(const char *FileName)
+**
+** DESCRIPTION : Replace the rules with the contents of a
+**    public_suffix_list.dat file
+**
+** RETURN VALUE: false if the file cannot be read; the rules are unchanged
+**                                                                           */
+/*=***************************************************************************/
+bool PublicSuffixListC::LoadFile(const char *FileName)
+{
+   FILE       *File;
+   std::string Rules;
+   char        Buffer[4096];
+   size_t      Len;
+
+   if (IsEmptyString(FileName))
+      return false;
+
+   File = fopen(FileName, "rb");
+   if (!File)
+      return false;
+
+   while ((Len = fread(Buffer, 1, sizeof(Buffer), File)) > 0)
+      Rules.append(Buffer, Len);
+   if (ferror(File))
+   {
+      fclose(File);
+      return false;
+   }
+   fclose(File);
+
+   return LoadString(Rules.c_str());
+}
+
+/*=****************************************************************************
+**
+** const EdgeS *PublicSuffixListC::FindEdge(uint32_t Node, const char
+**    *Label, size_t Len) const
+**
+** DESCRIPTION : Binary search the edges of <Node> for <Label>, ignoring
+**    case
+**
+** RETURN VALUE: edge or nullptr
+**                                                                           */
+/*=***************************************************************************/
+const PublicSuffixListC::EdgeS *PublicSuffixListC::FindEdge(uint32_t Node, const char *Label, size_t Len) const
+{
+   const EdgeS *Low  = mEdges.data() + mNodes[Node].FirstEdge;
+   const EdgeS *High = Low + mNodes[Node].EdgeCount;
+
+   while (Low < High)
+   {
+      const EdgeS         *Mid      = Low + (High - Low) / 2;
+      const unsigned char *EdgeText = (const unsigned char *) mLabels.data() + Mid->LabelOffset;
+      size_t               MinLen   = std::min<size_t>(Mid->LabelLen, Len);
+      int                  Cmp      = 0;
+
+      for (size_t i = 0; i < MinLen && Cmp == 0; i++)
+         Cmp = (int) EdgeText[i] - tolower((unsigned char) Label[i]);
+      if (Cmp == 0)
+         Cmp = (Mid->LabelLen < Len) ? -1 : (Mid->LabelLen > Len);
+
+      if (Cmp == 0)
+         return Mid;
+      if (Cmp < 0)
+         Low = Mid + 1;
+      else
+         High = Mid;
+   }
+   return nullptr;
+}
+
+/*=****************************************************************************
+**
+** const char *PublicSuffixListC::FindSuffix(const char *Host, bool
+**    *IsExplicit) const
+**
+** DESCRIPTION : Walk the labels of <Host> right to left and find where its
+**    public suffix starts. Exception rules win over all others, otherwise
+**    the longest matching rule wins, otherwise the last label (the
+**    implicit "*" rule).
+**
+** RETURN VALUE: pointer into <Host>; <IsExplicit> tells whether a listed
+**    rule matched
+**                                                                           */
+/*=***************************************************************************/
+const char *PublicSuffixListC::FindSuffix(const char *Host, bool *IsExplicit) const
+{
+   const char *HostEnd = Host + strlen(Host);
+   const char *LabelEnd;
+   const char *LabelStart;
+   const char *Suffix = nullptr;
+   uint32_t    Node   = mRoot;
+
+   if (HostEnd > Host && HostEnd[-1] == '.')
+      HostEnd--;
+   LabelEnd = HostEnd;
+
+   for (;;)
+   {
+      const EdgeS *Exact;
+      const EdgeS *Wild;
+
+      LabelStart = LabelEnd;
+      while (LabelStart > Host && LabelStart[-1] != '.')
+         LabelStart--;
+
+      Exact = FindEdge(Node, LabelStart, LabelEnd - LabelStart);
+      Wild  = FindEdge(Node, "*", 1);
+
+      if (Exact && (mNodes[Exact->Target].Flags & NODE_EXCEPTION))
+      {
+         Suffix = (LabelEnd < HostEnd) ? LabelEnd + 1 : nullptr;
+         break;
+      }
+      if ((Exact && (mNodes[Exact->Target].Flags & NODE_RULE)) || (Wild && (mNodes[Wild->Target].Flags & NODE_RULE)))
+         Suffix = LabelStart;
+
+      if (!Exact || LabelStart == Host)
+         break;
+      Node     = Exact->Target;
+      LabelEnd = LabelStart - 1;
+   }
+
+   *IsExplicit = (Suffix != nullptr);
+   if (!Suffix)
+   {
+      // implicit "*" rule: the last label
+      Suffix = HostEnd;
+      while (Suffix > Host && Suffix[-1] != '.')
+         Suffix--;
+   }
+   return Suffix;
+}
+
+/*=****************************************************************************
+**
+** const char *PublicSuffixListC::RegistrableDomain(const char *Host) const
+**
+** DESCRIPTION : Public suffix of <Host> plus one label ("eTLD+1"), e.g.
+**    "example.co.uk" for "www.example.co.uk"
+**
+** RETURN VALUE: pointer into <Host>, nullptr if <Host> is itself a public
+**    suffix; an IP literal is returned whole
+**                                                                           */
+/*=***************************************************************************/
+const char *PublicSuffixListC::RegistrableDomain(const char *Host) const
+{
+   const char *Suffix;
+   bool        IsExplicit;
+
+   if (IsEmptyString(Host))
+      return nullptr;
+   if (*Host == '.')
+      Host++;
+   if (IsIpLiteral(Host))
+      return Host;
+
+   Suffix = FindSuffix(Host, &IsExplicit);
+   if (Suffix == Host)
+      return nullptr;
+
+   Suffix--; // the dot in front of the suffix
+   while (Suffix > Host && Suffix[-1] != '.')
+      Suffix--;
+   return Suffix;
+}
+
+/*=****************************************************************************
+**
+** bool PublicSuffixListC::IsPublicSuffix(const char *Host) const
+**
+** DESCRIPTION : Whether <Host> is exactly a public suffix, by a listed
+**    rule or by the implicit "*" rule (any single label host, such as "kr"
+**    or "localhost")
+**
+** RETURN VALUE:
+**                                                                           */
+/*=***************************************************************************/
+bool PublicSuffixListC::IsPublicSuffix(const char *Host) const
+{
+   bool IsExplicit;
+
+   if (IsEmptyString(Host))
+      return false;
+   if (*Host == '.')
+      Host++;
+   if (IsIpLiteral(Host))
+      return false;
+
+   return FindSuffix(Host, &IsExplicit) == Host;
+}
+
+/*=****************************************************************************
+**
+** bool PublicSuffixListC::IsIpLiteral(const char *Host)
+**
+** DESCRIPTION : Whether <Host> is an IPv4 address in dotted-quad form or
+**    an IPv6 address, with or without brackets
+**
+** RETURN VALUE:
+**                                                                           */
+/*=***************************************************************************/
+bool PublicSuffixListC::IsIpLiteral(const char *Host)
+{
+   int Parts = 0;
+
+   if (IsEmptyString(Host))
+      return false;
+   if (*Host == '[' || strchr(Host, ':'))
+      return true;
+
+   for (;;)
+   {
+      unsigned Value  = 0;
+      int      Digits = 0;
+
+      for (; isdigit((unsigned char) *Host) && Digits < 4; Host++, Digits++)
+         Value = Value * 10 + (*Host - '0');
+      if (Digits == 0 || Digits > 3 || Value > 255)
+         return false;
+      Parts++;
+      if (*Host != '.')
+         break;
+      Host++;
+   }
+   return Parts == 4 && *Host == '\0';
+}
+
+/*=****************************************************************************
+**
+** size_t PublicSuffixListC::NodeCount() const
+**
+** DESCRIPTION :
+**
+** RETURN VALUE:
+**                                                                           */
+/*=***************************************************************************/
+size_t PublicSuffixListC::NodeCount() const
+{
+   return mNodes.size();
+}
+
+/*=****************************************************************************
+**
+** class CookieDomainFilterC
+**
+** DESCRIPTION : Blocked Bloom filter over the domains of a cookie jar.
+**
+**    Each key sets 6 bits inside a single 64-byte block, so a lookup is one
+**    hash and one cache line. Matching is case-insensitive. Bits cannot be
+**    cleared; the owner rebuilds the filter once enough keys are gone.
+**                                                                           */
+/*=***************************************************************************/
+class CookieDomainFilterC
+{
+ public:
+   CookieDomainFilterC();
+
+   void   Reset(size_t Capacity);
+   void   Add(const char *Str, size_t Len);
+   bool   MayContain(const char *Str, size_t Len) const;
+   size_t Count() const;
+   size_t Capacity() const;
+
+ private:
+   enum
+   {
+      WORDS_PER_BLOCK = 8, // 512 bits = one cache line
+      BITS_PER_KEY    = 10,
+      PROBES          = 6
+   };
+
+   static uint64_t Hash(const char *Str, size_t Len);
+
+   std::vector<uint64_t> mBits;
+   size_t                mBlockMask;
+   size_t                mCount;
+   size_t                mCapacity;
+};
+
+/*=****************************************************************************
+**
+** CookieDomainFilterC::CookieDomainFilterC()
+**
+** DESCRIPTION : Constructor
+**
+** RETURN VALUE:
+**                                                                           */
+/*=***************************************************************************/
+CookieDomainFilterC::CookieDomainFilterC() :
+   mBlockMask(0),
+   mCount(0),
+   mCapacity(0)
+{
+   Reset(64);
+}
+
+/*=****************************************************************************
+**
+** void CookieDomainFilterC::Reset(size_t Capacity)
+**
+** DESCRIPTION : Clear the filter and size it for <Capacity> keys at about
+**    1% false positives
+**
+** RETURN VALUE:
+**                                                                           */
+/*=***************************************************************************/
+void CookieDomainFilterC::Reset(size_t Capacity)
+{
+   size_t Blocks = 1;
+
+   while (Blocks * WORDS_PER_BLOCK * 64 < Capacity * BITS_PER_KEY)
+      Blocks <<= 1;
+
+   mBits.assign(Blocks * WORDS_PER_BLOCK, 0);
+   mBlockMask = Blocks - 1;
+   mCount     = 0;
+   mCapacity  = Capacity;
+}
+
+/*=****************************************************************************
+**
+** uint64_t CookieDomainFilterC::Hash(const char *Str, size_t Len)
+**
+** DESCRIPTION : Case-insensitive FNV-1a
+**
+** RETURN VALUE:
+**                                                                           */
+/*=***************************************************************************/
+uint64_t CookieDomainFilterC::Hash(const char *Str, size_t Len)
+{
+   uint64_t Hash = 14695981039346656037ULL;
+
+   while (Len--)
+   {
+      Hash ^= (unsigned char) tolower((unsigned char) *Str++);
+      Hash *= 1099511628211ULL;
+   }
+   return Hash;
+}
+
+/*=****************************************************************************
+**
+** void CookieDomainFilterC::Add(const char *Str, size_t Len)
+**
+** DESCRIPTION :
+**
+** RETURN VALUE:
+**                                                                           */
+/*=***************************************************************************/
+void CookieDomainFilterC::Add(const char *Str, size_t Len)
+{
+   uint64_t  H     = Hash(Str, Len);
+   uint64_t  Bits  = H * 0x9E3779B97F4A7C15ULL;
+   uint64_t *Block = &mBits[((H >> 32) & mBlockMask) * WORDS_PER_BLOCK];
+
+   for (int i = 0; i < PROBES; i++, Bits >>= 9)
+      Block[(Bits >> 6) & 7] |= 1ULL << (Bits & 63);
+   mCount++;
+}
+
+/*=****************************************************************************
+**
+** bool CookieDomainFilterC::MayContain(const char *Str, size_t Len) const
+**
+** DESCRIPTION :
+**
+** RETURN VALUE: false if <Str> was definitely never added
+**                                                                           */
+/*=***************************************************************************/
+bool CookieDomainFilterC::MayContain(const char *Str, size_t Len) const
+{
+   uint64_t        H     = Hash(Str, Len);
+   uint64_t        Bits  = H * 0x9E3779B97F4A7C15ULL;
+   const uint64_t *Block = &mBits[((H >> 32) & mBlockMask) * WORDS_PER_BLOCK];
+
+   for (int i = 0; i < PROBES; i++, Bits >>= 9)
+   {
+      if (!(Block[(Bits >> 6) & 7] & (1ULL << (Bits & 63))))
+         return false;
+   }
+   return true;
+}
+
+size_t CookieDomainFilterC::Count() const
+{
+   return mCount;
+}
+
+size_t CookieDomainFilterC::Capacity() const
+{
+   return mCapacity;
+}
+
+/*=****************************************************************************
+**
+** class CookieJarC
+**
+** DESCRIPTION : In-process cookie store with bounded memory use.
+**
+**    Every cookie sits on two intrusive LRU lists, one for its domain and
+**    one for the whole jar, so touching and evicting are O(1). When a limit
+**    is hit, expired cookies are dropped first (persistent cookies are also
+**    kept ordered by expiry), then the least recently used cookie of the
+**    domain, or of the jar, is evicted - the same order browsers use.
+**
+**    Cookies are grouped per registrable domain ("eTLD+1") according to a
+**    PublicSuffixListC, so "a.example.co.uk" and "b.example.co.uk" share
+**    one per-domain limit. Cookies set for a public suffix such as "co.uk"
+**    or "kr" (supercookies) are rejected, unless the suffix is the request
+**    host itself; such a cookie is only sent back to that exact host.
+**
+**    Every change gets a jar-wide sequence number, so ExportDelta() can
+**    encode only what changed since a peer last synced and ApplyDelta()
+**    can merge it in one batch (see ExportDelta for the format).
+**                                                                           */
+/*=***************************************************************************/
+class CookieJarC
+{
+ public:
+   explicit CookieJarC(const CookieJarLimitsS &Limits = CookieJarLimitsS(),
+                       const PublicSuffixListC *Psl = &PublicSuffixListC::Default());
+   ~CookieJarC();
+
+   void           SetPublicSuffixList(const PublicSuffixListC *Psl);
+
+   bool           Set(const CookieC &Cookie, const char *RequestHost = nullptr);
+   const CookieC *Find(const char *Name, const char *Domain, const char *Path);
+   bool           Remove(const char *Name, const char *Domain, const char *Path);
+   size_t         PurgeExpired(time_t Now);
+   size_t         Count() const;
+   size_t         CountForDomain(const char *Domain) const;
+   bool           HasCookiesForHost(const char *Host) const;
+   size_t         FindForHost(const char *Host, std::vector<const CookieC *> &Cookies);
+
+   uint64_t       GetSequence() const;
+   uint64_t       GetForgottenSequence() const;
+   size_t         ExportDelta(uint64_t SinceSequence, std::vector<unsigned char> &Delta) const;
+   long           ApplyDelta(const unsigned char *Delta, size_t Len, uint64_t *SenderSequence = nullptr);
+   size_t         PruneTombstones(uint64_t UpToSequence);
+
+ private:
+   enum
+   {
+      DELTA_SET    = 1,
+      DELTA_DELETE = 2,
+
+      DELTA_MIN_RECORD = 5, // kind, three empty strings, time
+
+      DELTA_SECURE       = 0x01,
+      DELTA_HTTPONLY     = 0x02,
+      DELTA_HAS_PATH     = 0x04,
+      DELTA_HAS_SAMESITE = 0x08
+   };
+
+   struct EntryS;
+
+   struct LinkS
+   {
+      EntryS *Prev = nullptr;
+      EntryS *Next = nullptr;
+   };
+
+   struct ListS
+   {
+      EntryS *Head  = nullptr; // most recently used
+      EntryS *Tail  = nullptr; // least recently used
+      size_t  Count = 0;
+   };
+
+   struct EntryS
+   {
+      CookieC                                   Cookie;
+      std::string                               Key;
+      std::string                               Domain;    // normalized cookie domain
+      std::string                               DomainKey; // registrable domain, groups the per-domain list
+      LinkS                                     GlobalLink;
+      LinkS                                     DomainLink;
+      LinkS                                     ChangeLink;
+      std::multimap<time_t, EntryS *>::iterator ExpiryPos;
+      bool                                      HasExpiry = false;
+      bool                                      HostOnly  = false; // public suffix domain, sent to that host only
+      uint64_t                                  Sequence  = 0;
+      time_t                                    Creation  = 0; // when this value was set
+   };
+
+   struct TombstoneS
+   {
+      uint64_t Sequence;
+      time_t   DeletedAt;
+   };
+
+   struct DeltaRecordS
+   {
+      int         Kind;
+      std::string Key;
+      time_t      Time; // creation for DELTA_SET, deletion for DELTA_DELETE
+      CookieC     Cookie;
+   };
+
+   CookieJarC(const CookieJarC &)            = delete;
+   CookieJarC &operator=(const CookieJarC &) = delete;
+
+   static std::string MakeKey(const char *Name, const char *Domain, const char *Path);
+   static std::string MakeDomainKey(const char *Domain);
+   static bool        DomainMatches(const std::string &Domain, const char *Host, size_t HostLen);
+   static void        ListPushFront(ListS &List, EntryS *Entry, LinkS EntryS::*Link);
+   static void        ListUnlink(ListS &List, EntryS *Entry, LinkS EntryS::*Link);
+
+   static void PutVarint(std::vector<unsigned char> &Out, uint64_t Value);
+   static void PutString(std::vector<unsigned char> &Out, const char *Str, size_t Len);
+   static bool GetVarint(const unsigned char *&Ptr, const unsigned char *End, uint64_t *Value);
+   static bool GetString(const unsigned char *&Ptr, const unsigned char *End, std::string &Str);
+   static bool GetRecord(const unsigned char *&Ptr, const unsigned char *End, DeltaRecordS &Rec);
+   static int  CompareContent(const CookieC &Cookie1, const CookieC &Cookie2);
+
+   bool Store(const CookieC &Cookie, time_t Creation, time_t Now, EntryS **Stored);
+   void Touch(EntryS *Entry);
+   void Erase(EntryS *Entry);
+   void AddTombstone(const std::string &Key, time_t DeletedAt);
+   void DropTombstone(const std::string &Key);
+   void EnforceLimits(const std::string &DomainKey, time_t Now);
+   void RebuildFilter();
+
+   std::string ShardKey(const char *Domain) const;
+
+   template <typename FuncT> bool ForEachHostCookie(const char *Host, FuncT Func) const;
+
+   CookieJarLimitsS                            mLimits;
+   std::unordered_map<std::string, EntryS *>   mEntries;
+   std::unordered_map<std::string, ListS>      mDomains;
+   std::multimap<time_t, EntryS *>             mExpiry;
+   ListS                                       mLru;
+   CookieDomainFilterC                         mFilter;
+   size_t                                      mFilterStale;
+   const PublicSuffixListC                    *mPsl;
+   uint64_t                                    mSequence;
+   ListS                                       mChanges; // by sequence, most recent first
+   std::unordered_map<std::string, TombstoneS> mTombstones;
+   std::map<uint64_t, std::string>             mTombstoneOrder;
+   uint64_t                                    mForgotten; // deletions up to here may be lost
+};
+
+/*=****************************************************************************
+**
+** CookieJarC::CookieJarC(const CookieJarLimitsS &Limits, const
+**    PublicSuffixListC *Psl)
+**
+** DESCRIPTION : Constructor. <Psl> must outlive the jar.
+**
+** RETURN VALUE:
+**                                                                           */
+/*=***************************************************************************/
+CookieJarC::CookieJarC(const CookieJarLimitsS &Limits, const PublicSuffixListC *Psl) :
+   mLimits(Limits),
+   mFilterStale(0),
+   mPsl(Psl),
+   mSequence(0),
+   mForgotten(0)
+{
+}
+
+/*=****************************************************************************
+**
+** CookieJarC::~CookieJarC()
+**
+** DESCRIPTION : Destructor
+**
+** RETURN VALUE:
+**                                                                           */
+/*=***************************************************************************/
+CookieJarC::~CookieJarC()
+{
+   for (auto &It : mEntries)
+      delete It.second;
+}
+
+/*=****************************************************************************
+**
+** void CookieJarC::SetPublicSuffixList(const PublicSuffixListC *Psl)
+**
+** DESCRIPTION : Switch to another (e.g. newly loaded) suffix list.
+**    Regroups all cookies by their new registrable domain, keeping their
+**    LRU order, and drops cookies whose domain is now a public suffix
+**    unless they were accepted from that host. Groups left over the
+**    per-domain limit are trimmed on their next Set.
+**
+** RETURN VALUE:
+**                                                                           */
+/*=***************************************************************************/
+void CookieJarC::SetPublicSuffixList(const PublicSuffixListC *Psl)
+{
+   std::vector<EntryS *> Rejected;
+
+   mPsl = Psl;
+   mDomains.clear();
+   for (EntryS *Entry = mLru.Tail; Entry; Entry = Entry->GlobalLink.Prev)
+   {
+      Entry->DomainKey = ShardKey(Entry->Cookie.GetDomain());
+      ListPushFront(mDomains[Entry->DomainKey], Entry, &EntryS::DomainLink);
+      if (!Entry->HostOnly && mPsl->IsPublicSuffix(Entry->Cookie.GetDomain()))
+         Rejected.push_back(Entry);
+   }
+   RebuildFilter();
+
+   for (EntryS *Entry : Rejected)
+      Erase(Entry);
+}
+
+/*=****************************************************************************
+**
+** std::string CookieJarC::MakeKey(const char *Name, const char *Domain,
+**    const char *Path)
+**
+** DESCRIPTION : (name, domain, path) identity of a cookie
+**
+** RETURN VALUE:
+**                                                                           */
+/*=***************************************************************************/
+std::string CookieJarC::MakeKey(const char *Name, const char *Domain, const char *Path)
+{
+   std::string Key;
+
+   Key.append(Name ? Name : "").push_back('\0');
+   Key.append(MakeDomainKey(Domain)).push_back('\0');
+   Key.append(Path ? Path : "/");
+   return Key;
+}
+
+/*=****************************************************************************
+**
+** std::string CookieJarC::MakeDomainKey(const char *Domain)
+**
+** DESCRIPTION : Lower-cased domain without the leading dot, used to group
+**    cookies per domain
+**
+** RETURN VALUE:
+**                                                                           */
+/*=***************************************************************************/
+std::string CookieJarC::MakeDomainKey(const char *Domain)
+{
+   std::string Key;
+
+   if (!Domain)
+      return Key;
+   if (*Domain == '.')
+      Domain++;
+   for (; *Domain; Domain++)
+      Key.push_back((char) tolower((unsigned char) *Domain));
+   return Key;
+}
+
+/*=****************************************************************************
+**
+** std::string CookieJarC::ShardKey(const char *Domain) const
+**
+** DESCRIPTION : Registrable domain of <Domain>, or the whole domain when
+**    it has none (e.g. "localhost") or is an IP literal, so that
+**    "10.0.0.1" and "192.168.0.1" are not grouped as "0.1"
+**
+** RETURN VALUE:
+**                                                                           */
+/*=***************************************************************************/
+std::string CookieJarC::ShardKey(const char *Domain) const
+{
+   const char *Registrable = mPsl->RegistrableDomain(Domain);
+
+   return MakeDomainKey(Registrable ? Registrable : Domain);
+}
+
+/*=****************************************************************************
+**
+** bool CookieJarC::DomainMatches(const std::string &Domain, const char
+**    *Host, size_t HostLen)
+**
+** DESCRIPTION : RFC 6265 domain-match: <Host> equals <Domain> or is a
+**    subdomain of it. <Domain> is normalized, <Host> may be in any case.
+**
+** RETURN VALUE:
+**                                                                           */
+/*=***************************************************************************/
+bool CookieJarC::DomainMatches(const std::string &Domain, const char *Host, size_t HostLen)
+{
+   const char *Tail;
+
+   if (HostLen < Domain.size())
+      return false;
+
+   Tail = Host + HostLen - Domain.size();
+   if (Tail != Host && Tail[-1] != '.')
+      return false;
+
+   for (size_t i = 0; i < Domain.size(); i++)
+   {
+      if (tolower((unsigned char) Tail[i]) != Domain[i])
+         return false;
+   }
+   return true;
+}
+
+/*=****************************************************************************
+**
+** void CookieJarC::ListPushFront(ListS &List, EntryS *Entry, LinkS
+**    EntryS::*Link)
+**
+** DESCRIPTION : Insert <Entry> as most recently used on the list threaded
+**    through its <Link> member
+**
+** RETURN VALUE:
+**                                                                           */
+/*=***************************************************************************/
+void CookieJarC::ListPushFront(ListS &List, EntryS *Entry, LinkS EntryS::*Link)
+{
+   (Entry->*Link).Prev = nullptr;
+   (Entry->*Link).Next = List.Head;
+   if (List.Head)
+      (List.Head->*Link).Prev = Entry;
+   else
+      List.Tail = Entry;
+   List.Head = Entry;
+   List.Count++;
+}
+
+/*=****************************************************************************
+**
+** void CookieJarC::ListUnlink(ListS &List, EntryS *Entry, LinkS
+**    EntryS::*Link)
+**
+** DESCRIPTION :
+**
+** RETURN VALUE:
+**                                                                           */
+/*=***************************************************************************/
+void CookieJarC::ListUnlink(ListS &List, EntryS *Entry, LinkS EntryS::*Link)
+{
+   LinkS &L = Entry->*Link;
+
+   if (L.Prev)
+      (L.Prev->*Link).Next = L.Next;
+   else
+      List.Head = L.Next;
+   if (L.Next)
+      (L.Next->*Link).Prev = L.Prev;
+   else
+      List.Tail = L.Prev;
+   L.Prev = L.Next = nullptr;
+   List.Count--;
+}
+
+/*=****************************************************************************
+**
+** void CookieJarC::Touch(EntryS *Entry)
+**
+** DESCRIPTION : Mark <Entry> as most recently used
+**
+** RETURN VALUE:
+**                                                                           */
+/*=***************************************************************************/
+void CookieJarC::Touch(EntryS *Entry)
+{
+   ListS &Domain = mDomains[Entry->DomainKey];
+
+   ListUnlink(mLru, Entry, &EntryS::GlobalLink);
+   ListPushFront(mLru, Entry, &EntryS::GlobalLink);
+   ListUnlink(Domain, Entry, &EntryS::DomainLink);
+   ListPushFront(Domain, Entry, &EntryS::DomainLink);
+}
+
+/*=****************************************************************************
+**
+** void CookieJarC::Erase(EntryS *Entry)
+**
+** DESCRIPTION : Remove <Entry> from all indexes and free it
+**
+** RETURN VALUE:
+**                                                                           */
+/*=***************************************************************************/
+void CookieJarC::Erase(EntryS *Entry)
+{
+   auto DomainIt = mDomains.find(Entry->DomainKey);
+
+   ListUnlink(mLru, Entry, &EntryS::GlobalLink);
+   ListUnlink(mChanges, Entry, &EntryS::ChangeLink);
+   ListUnlink(DomainIt->second, Entry, &EntryS::DomainLink);
+   if (DomainIt->second.Count == 0)
+   {
+      mDomains.erase(DomainIt);
+      if (++mFilterStale > mDomains.size())
+         RebuildFilter();
+   }
+   if (Entry->HasExpiry)
+      mExpiry.erase(Entry->ExpiryPos);
+   mEntries.erase(Entry->Key);
+   delete Entry;
+}
+
+/*=****************************************************************************
+**
+** void CookieJarC::EnforceLimits(const std::string &DomainKey, time_t Now)
+**
+** DESCRIPTION : Evict until <DomainKey> and the jar are within limits:
+**    expired cookies first, then least recently used ones.
+**
+** RETURN VALUE:
+**                                                                           */
+/*=***************************************************************************/
+void CookieJarC::EnforceLimits(const std::string &DomainKey, time_t Now)
+{
+   auto DomainIt = mDomains.find(DomainKey);
+
+   if ((DomainIt == mDomains.end() || DomainIt->second.Count <= mLimits.MaxCookiesPerDomain) &&
+       mLru.Count <= mLimits.MaxCookies)
+      return;
+
+   PurgeExpired(Now);
+
+   DomainIt = mDomains.find(DomainKey);
+   while (DomainIt != mDomains.end() && DomainIt->second.Count > mLimits.MaxCookiesPerDomain)
+   {
+      Erase(DomainIt->second.Tail);
+      DomainIt = mDomains.find(DomainKey);
+   }
+
+   while (mLru.Count > mLimits.MaxCookies)
+      Erase(mLru.Tail);
+}
+
+/*=****************************************************************************
+**
+** bool CookieJarC::Set(const CookieC &Cookie, const char *RequestHost)
+**
+** DESCRIPTION : Store a copy of <Cookie>, received from <RequestHost>,
+**    replacing one with the same (name, domain, path). A cookie that is
+**    already expired deletes the stored one, as for a Set-Cookie header.
+**
+**    As in RFC 6265 5.3 step 5, a cookie whose domain is a public suffix is
+**    only accepted when that domain is <RequestHost>, and is then only
+**    sent back to that host. Without <RequestHost> it is always rejected.
+**
+** RETURN VALUE: false when the cookie has no name, is set for a public
+**    suffix or exceeds MaxCookieSize
+**                                                                           */
+/*=***************************************************************************/
+bool CookieJarC::Set(const CookieC &Cookie, const char *RequestHost)
+{
+   time_t  Now      = time(nullptr);
+   bool    HostOnly = mPsl->IsPublicSuffix(Cookie.GetDomain());
+   EntryS *Entry;
+
+   if (HostOnly && (!RequestHost || MakeDomainKey(RequestHost) != MakeDomainKey(Cookie.GetDomain())))
+      return false;
+
+   if (!Store(Cookie, Now, Now, &Entry))
+      return false;
+
+   if (Entry)
+   {
+      Entry->HostOnly = HostOnly;
+      EnforceLimits(Entry->DomainKey, Now);
+   }
+   return true;
+}
+
+/*=****************************************************************************
+**
+** bool CookieJarC::Store(const CookieC &Cookie, time_t Creation, time_t
+**    Now, EntryS **Stored)
+**
+** DESCRIPTION : Set() without the public suffix and limit checks, so
+**    ApplyDelta can check once per batch. Records the change with a new
+**    sequence number.
+**
+** RETURN VALUE: as Set(); <Stored> is the entry, nullptr if <Cookie> was a
+**    deletion
+**                                                                           */
+/*=***************************************************************************/
+bool CookieJarC::Store(const CookieC &Cookie, time_t Creation, time_t Now, EntryS **Stored)
+{
+   time_t      Expires;
+   std::string Key;
+   EntryS     *Entry;
+
+   *Stored = nullptr;
+   if (IsEmptyString(Cookie.GetName()))
+      return false;
+   if (strlen(Cookie.GetName()) + (Cookie.GetValue() ? strlen(Cookie.GetValue()) : 0) > mLimits.MaxCookieSize)
+      return false;
+
+   Key     = MakeKey(Cookie.GetName(), Cookie.GetDomain(), Cookie.GetPath());
+   Expires = Cookie.GetExpiresTime();
+
+   auto It = mEntries.find(Key);
+   if (Expires != 0 && Expires <= Now)
+   {
+      if (It != mEntries.end())
+      {
+         Erase(It->second);
+         AddTombstone(Key, Creation);
+      }
+      return true;
+   }
+
+   if (It != mEntries.end())
+   {
+      Entry         = It->second;
+      Entry->Cookie = Cookie;
+      if (Entry->HasExpiry)
+         mExpiry.erase(Entry->ExpiryPos);
+      Touch(Entry);
+      ListUnlink(mChanges, Entry, &EntryS::ChangeLink);
+   }
+   else
+   {
+      Entry            = new EntryS();
+      Entry->Cookie    = Cookie;
+      Entry->Key       = Key;
+      Entry->Domain    = MakeDomainKey(Cookie.GetDomain());
+      Entry->DomainKey = ShardKey(Cookie.GetDomain());
+      mEntries.emplace(Key, Entry);
+      ListPushFront(mLru, Entry, &EntryS::GlobalLink);
+
+      auto DomainIt = mDomains.try_emplace(Entry->DomainKey);
+      ListPushFront(DomainIt.first->second, Entry, &EntryS::DomainLink);
+      if (DomainIt.second)
+      {
+         if (mFilter.Count() >= mFilter.Capacity())
+            RebuildFilter();
+         else
+            mFilter.Add(Entry->DomainKey.data(), Entry->DomainKey.size());
+      }
+      DropTombstone(Key);
+   }
+
+   Entry->HasExpiry = (Expires != 0);
+   if (Entry->HasExpiry)
+      Entry->ExpiryPos = mExpiry.emplace(Expires, Entry);
+
+   Entry->Sequence = ++mSequence;
+   Entry->Creation = Creation;
+   ListPushFront(mChanges, Entry, &EntryS::ChangeLink);
+
+   *Stored = Entry;
+   return true;
+}
+
+/*=****************************************************************************
+**
+** const CookieC *CookieJarC::Find(const char *Name, const char *Domain,
+**    const char *Path)
+**
+** DESCRIPTION : Look up a cookie and mark it as recently used
+**
+** RETURN VALUE: cookie owned by the jar, valid until the next Set/Remove/
+**    PurgeExpired; nullptr if not found
+**                                                                           */
+/*=***************************************************************************/
+const CookieC *CookieJarC::Find(const char *Name, const char *Domain, const char *Path)
+{
+   auto It = mEntries.find(MakeKey(Name, Domain, Path));
+
+   if (It == mEntries.end())
+      return nullptr;
+
+   Touch(It->second);
+   return &It->second->Cookie;
+}
+
+/*=****************************************************************************
+**
+** bool CookieJarC::Remove(const char *Name, const char *Domain, const char
+**    *Path)
+**
+** DESCRIPTION : Delete a cookie. Unlike eviction and expiry, this is
+**    recorded for ExportDelta so peers delete it too.
+**
+** RETURN VALUE: true if the cookie was found
+**                                                                           */
+/*=***************************************************************************/
+bool CookieJarC::Remove(const char *Name, const char *Domain, const char *Path)
+{
+   std::string Key = MakeKey(Name, Domain, Path);
+   auto        It  = mEntries.find(Key);
+
+   if (It == mEntries.end())
+      return false;
+
+   Erase(It->second);
+   AddTombstone(Key, time(nullptr));
+   return true;
+}
+
+/*=****************************************************************************
+**
+** size_t CookieJarC::PurgeExpired(time_t Now)
+**
+** DESCRIPTION : Drop every cookie that expired at or before <Now>
+**
+** RETURN VALUE: number of cookies dropped
+**                                                                           */
+/*=***************************************************************************/
+size_t CookieJarC::PurgeExpired(time_t Now)
+{
+   size_t Purged = 0;
+
+   while (!mExpiry.empty() && mExpiry.begin()->first <= Now)
+   {
+      Erase(mExpiry.begin()->second);
+      Purged++;
+   }
+   return Purged;
+}
+
+/*=****************************************************************************
+**
+** size_t CookieJarC::Count() const
+**
+** DESCRIPTION :
+**
+** RETURN VALUE:
+**                                                                           */
+/*=***************************************************************************/
+size_t CookieJarC::Count() const
+{
+   return mLru.Count;
+}
+
+/*=****************************************************************************
+**
+** size_t CookieJarC::CountForDomain(const char *Domain) const
+**
+** DESCRIPTION : Number of cookies sharing the registrable domain of
+**    <Domain>
+**
+** RETURN VALUE:
+**                                                                           */
+/*=***************************************************************************/
+size_t CookieJarC::CountForDomain(const char *Domain) const
+{
+   auto It = mDomains.find(ShardKey(Domain));
+
+   return (It == mDomains.end()) ? 0 : It->second.Count;
+}
+
+/*=****************************************************************************
+**
+** void CookieJarC::RebuildFilter()
+**
+** DESCRIPTION : Refill the domain filter from the live domains, sized with
+**    room to grow so rebuilds stay amortized O(1) per insert/delete
+**
+** RETURN VALUE:
+**                                                                           */
+/*=***************************************************************************/
+void CookieJarC::RebuildFilter()
+{
+   mFilter.Reset(std::max<size_t>(64, 2 * mDomains.size()));
+   for (auto &It : mDomains)
+      mFilter.Add(It.first.data(), It.first.size());
+   mFilterStale = 0;
+}
+
+/*=****************************************************************************
+**
+** template <typename FuncT> bool CookieJarC::ForEachHostCookie(const char
+**    *Host, FuncT Func) const
+**
+** DESCRIPTION : Call <Func> with every unexpired entry that domain-matches
+**    <Host>. All such cookies share the registrable domain of <Host>, so
+**    this is one filter check and, only if the filter may contain it, one
+**    probe of the domain index. Expired entries are skipped, not erased;
+**    PurgeExpired or the next Set removes them. Stops when <Func> returns
+**    false. <Func> must not reorder the domain list.
+**
+** RETURN VALUE: false if <Func> stopped the walk
+**                                                                           */
+/*=***************************************************************************/
+template <typename FuncT> bool CookieJarC::ForEachHostCookie(const char *Host, FuncT Func) const
+{
+   const char *Shard;
+   size_t      HostLen;
+   time_t      Now;
+
+   if (IsEmptyString(Host))
+      return true;
+   if (*Host == '.')
+      Host++;
+
+   Shard = mPsl->RegistrableDomain(Host);
+   if (!Shard)
+      Shard = Host;
+   if (!mFilter.MayContain(Shard, strlen(Shard)))
+      return true;
+
+   auto It = mDomains.find(MakeDomainKey(Shard));
+   if (It == mDomains.end())
+      return true;
+
+   HostLen = strlen(Host);
+   Now     = time(nullptr);
+   for (EntryS *Entry = It->second.Head; Entry; Entry = Entry->DomainLink.Next)
+   {
+      if (Entry->HasExpiry && Entry->ExpiryPos->first <= Now)
+         continue;
+      if (Entry->HostOnly ? !StrCaseEq(Entry->Domain.c_str(), Host) : !DomainMatches(Entry->Domain, Host, HostLen))
+         continue;
+      if (!Func(Entry))
+         return false;
+   }
+   return true;
+}
+
+/*=****************************************************************************
+**
+** bool CookieJarC::HasCookiesForHost(const char *Host) const
+**
+** DESCRIPTION : Whether any cookie domain-matches <Host>
+**
+** RETURN VALUE:
+**                                                                           */
+/*=***************************************************************************/
+bool CookieJarC::HasCookiesForHost(const char *Host) const
+{
+   return !ForEachHostCookie(Host, [](const EntryS *) { return false; });
+}
+
+/*=****************************************************************************
+**
+** size_t CookieJarC::FindForHost(const char *Host, std::vector<const
+**    CookieC *> &Cookies)
+**
+** DESCRIPTION : Append every unexpired cookie that domain-matches <Host> to
+**    <Cookies>, most recently used first, and mark them as recently used
+**
+** RETURN VALUE: number of cookies appended; the pointers are valid until
+**    the next Set/Remove/PurgeExpired
+**                                                                           */
+/*=***************************************************************************/
+size_t CookieJarC::FindForHost(const char *Host, std::vector<const CookieC *> &Cookies)
+{
+   std::vector<EntryS *> Found;
+
+   ForEachHostCookie(Host, [&Found](EntryS *Entry) {
+      Found.push_back(Entry);
+      return true;
+   });
+
+   // Touch least recently used first so the found cookies keep their
+   // relative order at the front of the lists
+   for (auto It = Found.rbegin(); It != Found.rend(); ++It)
+      Touch(*It);
+   for (EntryS *Entry : Found)
+      Cookies.push_back(&Entry->Cookie);
+   return Found.size();
+}
+
+/*=****************************************************************************
+**
+** void CookieJarC::AddTombstone(const std::string &Key, time_t DeletedAt)
+**
+** DESCRIPTION : Remember a deletion so ExportDelta can pass it on. At most
+**    MaxCookies deletions are kept; beyond that the oldest is forgotten
+**    (see GetForgottenSequence).
+**
+** RETURN VALUE:
+**                                                                           */
+/*=***************************************************************************/
+void CookieJarC::AddTombstone(const std::string &Key, time_t DeletedAt)
+{
+   DropTombstone(Key);
+   mTombstones[Key] = {++mSequence, DeletedAt};
+   mTombstoneOrder.emplace(mSequence, Key);
+
+   if (mTombstones.size() > mLimits.MaxCookies)
+      PruneTombstones(mTombstoneOrder.begin()->first);
+}
+
+/*=****************************************************************************
+**
+** void CookieJarC::DropTombstone(const std::string &Key)
+**
+** DESCRIPTION :
+**
+** RETURN VALUE:
+**                                                                           */
+/*=***************************************************************************/
+void CookieJarC::DropTombstone(const std::string &Key)
+{
+   auto It = mTombstones.find(Key);
+
+   if (It == mTombstones.end())
+      return;
+
+   mTombstoneOrder.erase(It->second.Sequence);
+   mTombstones.erase(It);
+}
+
+/*=****************************************************************************
+**
+** size_t CookieJarC::PruneTombstones(uint64_t UpToSequence)
+**
+** DESCRIPTION : Forget deletions up to <UpToSequence>, once every peer has
+**    synced past it
+**
+** RETURN VALUE: number of deletions forgotten
+**                                                                           */
+/*=***************************************************************************/
+size_t CookieJarC::PruneTombstones(uint64_t UpToSequence)
+{
+   size_t Pruned = 0;
+
+   while (!mTombstoneOrder.empty() && mTombstoneOrder.begin()->first <= UpToSequence)
+   {
+      mForgotten = mTombstoneOrder.begin()->first;
+      mTombstones.erase(mTombstoneOrder.begin()->second);
+      mTombstoneOrder.erase(mTombstoneOrder.begin());
+      Pruned++;
+   }
+   return Pruned;
+}
+
+/*=****************************************************************************
+**
+** uint64_t CookieJarC::GetSequence() const
+**
+** DESCRIPTION : Sequence number of the latest change, pass it to
+**    ExportDelta next time to get only what changed since
+**
+** RETURN VALUE:
+**                                                                           */
+/*=***************************************************************************/
+uint64_t CookieJarC::GetSequence() const
+{
+   return mSequence;
+}
+
+/*=****************************************************************************
+**
+** uint64_t CookieJarC::GetForgottenSequence() const
+**
+** DESCRIPTION : Sequence number of the latest deletion that is no longer
+**    remembered, because of PruneTombstones or because more than
+**    MaxCookies deletions happened since. A delta since an older sequence
+**    may miss deletions: a peer that lagged that far behind should clear
+**    its jar and apply a full snapshot (ExportDelta since 0) instead.
+**
+** RETURN VALUE: 0 if no deletion was forgotten
+**                                                                           */
+/*=***************************************************************************/
+uint64_t CookieJarC::GetForgottenSequence() const
+{
+   return mForgotten;
+}
+
+void CookieJarC::PutVarint(std::vector<unsigned char> &Out, uint64_t Value)
+{
+   while (Value >= 0x80)
+   {
+      Out.push_back((unsigned char) (Value | 0x80));
+      Value >>= 7;
+   }
+   Out.push_back((unsigned char) Value);
+}
+
+void CookieJarC::PutString(std::vector<unsigned char> &Out, const char *Str, size_t Len)
+{
+   PutVarint(Out, Len);
+   Out.insert(Out.end(), Str, Str + Len);
+}
+
+bool CookieJarC::GetVarint(const unsigned char *&Ptr, const unsigned char *End, uint64_t *Value)
+{
+   *Value = 0;
+   for (int Shift = 0; Shift < 64; Shift += 7)
+   {
+      if (Ptr == End)
+         return false;
+      *Value |= (uint64_t) (*Ptr & 0x7F) << Shift;
+      if (!(*Ptr++ & 0x80))
+         return true;
+   }
+   return false;
+}
+
+bool CookieJarC::GetString(const unsigned char *&Ptr, const unsigned char *End, std::string &Str)
+{
+   uint64_t Len;
+
+   if (!GetVarint(Ptr, End, &Len) || Len > (uint64_t) (End - Ptr))
+      return false;
+   Str.assign((const char *) Ptr, (size_t) Len);
+   Ptr += Len;
+   return true;
+}
+
+/*=****************************************************************************
+**
+** bool CookieJarC::GetRecord(const unsigned char *&Ptr, const unsigned
+**    char *End, DeltaRecordS &Rec)
+**
+** DESCRIPTION : Decode one ExportDelta record into <Rec>, which must be
+**    freshly constructed
+**
+** RETURN VALUE: false if the record is malformed or truncated
+**                                                                           */
+/*=***************************************************************************/
+bool CookieJarC::GetRecord(const unsigned char *&Ptr, const unsigned char *End, DeltaRecordS &Rec)
+{
+   std::string Name, Domain, Path, CookieValue, SameSite;
+   uint64_t    Value, Expires;
+   uint8_t     Flags;
+
+   if (Ptr == End)
+      return false;
+   Rec.Kind = *Ptr++;
+   if ((Rec.Kind != DELTA_SET && Rec.Kind != DELTA_DELETE) || !GetString(Ptr, End, Name) ||
+       !GetString(Ptr, End, Domain) || !GetString(Ptr, End, Path) || !GetVarint(Ptr, End, &Value))
+      return false;
+   Rec.Time = (time_t) Value;
+   if (Rec.Kind == DELTA_DELETE)
+   {
+      Rec.Key = MakeKey(Name.c_str(), Domain.c_str(), Path.c_str());
+      return true;
+   }
+
+   if (Ptr == End)
+      return false;
+   Flags = *Ptr++;
+   if (!GetVarint(Ptr, End, &Expires) || !GetString(Ptr, End, CookieValue) || !GetString(Ptr, End, SameSite))
+      return false;
+   Rec.Key = MakeKey(Name.c_str(), Domain.c_str(), (Flags & DELTA_HAS_PATH) ? Path.c_str() : nullptr);
+
+   Rec.Cookie.SetName(Name.c_str());
+   Rec.Cookie.SetValue(CookieValue.c_str());
+   if (!Domain.empty())
+      Rec.Cookie.SetDomain(Domain.c_str());
+   if (Flags & DELTA_HAS_PATH)
+      Rec.Cookie.SetPath(Path.c_str());
+   Rec.Cookie.SetExpires((time_t) Expires);
+   Rec.Cookie.SetSecure((Flags & DELTA_SECURE) != 0);
+   Rec.Cookie.SetHttpOnly((Flags & DELTA_HTTPONLY) != 0);
+   if (Flags & DELTA_HAS_SAMESITE)
+      Rec.Cookie.SetSameSite(SameSite.c_str());
+   return true;
+}
+
+/*=****************************************************************************
+**
+** int CookieJarC::CompareContent(const CookieC &Cookie1, const CookieC
+**    &Cookie2)
+**
+** DESCRIPTION : Total order over the replicated attributes other than the
+**    key and expiry (value bytes, then secure, httponly, samesite), the
+**    last tie-break of ApplyDelta so every replica picks the same winner
+**
+** RETURN VALUE: <0, 0 or >0 like strcmp
+**                                                                           */
+/*=***************************************************************************/
+int CookieJarC::CompareContent(const CookieC &Cookie1, const CookieC &Cookie2)
+{
+   const char *Value1 = Cookie1.GetValue() ? Cookie1.GetValue() : "";
+   const char *Value2 = Cookie2.GetValue() ? Cookie2.GetValue() : "";
+   int         Cmp;
+
+   Cmp = strcmp(Value1, Value2);
+   if (Cmp == 0)
+      Cmp = (int) Cookie1.IsSecure() - (int) Cookie2.IsSecure();
+   if (Cmp == 0)
+      Cmp = (int) Cookie1.IsHttpOnly() - (int) Cookie2.IsHttpOnly();
+   if (Cmp == 0)
+      Cmp = strcmp(Cookie1.GetSameSite() ? Cookie1.GetSameSite() : "",
+                   Cookie2.GetSameSite() ? Cookie2.GetSameSite() : "");
+   return Cmp;
+}
+
+/*=****************************************************************************
+**
+** size_t CookieJarC::ExportDelta(uint64_t SinceSequence,
+**    std::vector<unsigned char> &Delta) const
+**
+** DESCRIPTION : Encode every cookie set and every Remove() after
+**    <SinceSequence> (0 for a full snapshot). Walks the change list only
+**    as far back as <SinceSequence>. Evictions and expiry are local and
+**    not exported. Only the last MaxCookies deletions are remembered; if
+**    <SinceSequence> is below GetForgottenSequence() the delta may be
+**    missing some of them.
+**
+**    Format, integers as LEB128 varints, strings as length + bytes:
+**       "CKD1" <since> <sequence> <record count> <record>...
+**       record: <kind> <name> <domain> <path> <time>
+**               [<flags> <expires> <value> <samesite>]   for DELTA_SET
+**    <time> is the creation time for DELTA_SET and the deletion time for
+**    DELTA_DELETE, <expires> is 0 for session cookies.
+**
+** RETURN VALUE: number of records written to <Delta>
+**                                                                           */
+/*=***************************************************************************/
+size_t CookieJarC::ExportDelta(uint64_t SinceSequence, std::vector<unsigned char> &Delta) const
+{
+   std::vector<const EntryS *> Changed;
+   size_t                      Records;
+
+   for (const EntryS *Entry = mChanges.Head; Entry && Entry->Sequence > SinceSequence;
+        Entry = Entry->ChangeLink.Next)
+      Changed.push_back(Entry);
+
+   auto FirstTombstone = mTombstoneOrder.upper_bound(SinceSequence);
+   Records             = Changed.size() + std::distance(FirstTombstone, mTombstoneOrder.end());
+
+   Delta.assign({'C', 'K', 'D', '1'});
+   PutVarint(Delta, SinceSequence);
+   PutVarint(Delta, mSequence);
+   PutVarint(Delta, Records);
+
+   for (const EntryS *Entry : Changed)
+   {
+      const CookieC &C      = Entry->Cookie;
+      const char    *Domain = C.GetDomain() ? C.GetDomain() : "";
+      const char    *Path   = C.GetPath() ? C.GetPath() : "";
+      const char    *Value  = C.GetValue() ? C.GetValue() : "";
+      const char    *Site   = C.GetSameSite() ? C.GetSameSite() : "";
+
+      Delta.push_back(DELTA_SET);
+      PutString(Delta, C.GetName(), strlen(C.GetName()));
+      PutString(Delta, Domain, strlen(Domain));
+      PutString(Delta, Path, strlen(Path));
+      PutVarint(Delta, (uint64_t) Entry->Creation);
+      Delta.push_back((unsigned char) ((C.IsSecure() ? DELTA_SECURE : 0) | (C.IsHttpOnly() ? DELTA_HTTPONLY : 0) |
+                                       (C.GetPath() ? DELTA_HAS_PATH : 0) |
+                                       (C.GetSameSite() ? DELTA_HAS_SAMESITE : 0)));
+      PutVarint(Delta, Entry->HasExpiry ? (uint64_t) Entry->ExpiryPos->first : 0);
+      PutString(Delta, Value, strlen(Value));
+      PutString(Delta, Site, strlen(Site));
+   }
+
+   // the key is <name>\0<domain>\0<path>
+   for (auto It = FirstTombstone; It != mTombstoneOrder.end(); ++It)
+   {
+      const std::string &Key  = It->second;
+      size_t             Sep1 = Key.find('\0');
+      size_t             Sep2 = Key.find('\0', Sep1 + 1);
+
+      Delta.push_back(DELTA_DELETE);
+      PutString(Delta, Key.data(), Sep1);
+      PutString(Delta, Key.data() + Sep1 + 1, Sep2 - Sep1 - 1);
+      PutString(Delta, Key.data() + Sep2 + 1, Key.size() - Sep2 - 1);
+      PutVarint(Delta, (uint64_t) mTombstones.at(Key).DeletedAt);
+   }
+
+   return Records;
+}
+
+/*=****************************************************************************
+**
+** long CookieJarC::ApplyDelta(const unsigned char *Delta, size_t Len,
+**    uint64_t *SenderSequence)
+**
+** DESCRIPTION : Merge a delta from ExportDelta. The delta is validated in
+**    a first pass, so a malformed one changes nothing, and decoded again
+**    record by record while merging, so memory does not grow with the
+**    record count it claims; limits are enforced once per domain after
+**    the batch.
+**
+**    Conflicts on (name, domain, path) are resolved by creation time: a
+**    newer cookie wins, on equal creation the later expiry wins, and on
+**    equal expiry the greater content (CompareContent) wins, so replicas
+**    converge whatever order they exchange deltas in. A deletion wins over
+**    cookies created at or before it. Merged changes get local sequence
+**    numbers, so a central store can export them on to other nodes.
+**
+**    <SenderSequence> receives the sender's sequence at export time, to
+**    pass as <SinceSequence> when asking that node for the next delta.
+**
+** RETURN VALUE: number of records that changed the jar, -1 if <Delta> is
+**    malformed
+**                                                                           */
+/*=***************************************************************************/
+long CookieJarC::ApplyDelta(const unsigned char *Delta, size_t Len, uint64_t *SenderSequence)
+{
+   const unsigned char     *Ptr = Delta;
+   const unsigned char     *End = Delta + Len;
+   const unsigned char     *First;
+   std::vector<std::string> Touched;
+   uint64_t                 Since, Sequence, Count, i;
+   time_t                   Now     = time(nullptr);
+   long                     Applied = 0;
+
+   if (Len < 4 || memcmp(Delta, "CKD1", 4) != 0)
+      return -1;
+   Ptr += 4;
+   if (!GetVarint(Ptr, End, &Since) || !GetVarint(Ptr, End, &Sequence) || !GetVarint(Ptr, End, &Count) ||
+       Count > (uint64_t) (End - Ptr) / DELTA_MIN_RECORD)
+      return -1;
+
+   First = Ptr;
+   for (i = 0; i < Count; i++)
+   {
+      DeltaRecordS Rec;
+
+      if (!GetRecord(Ptr, End, Rec))
+         return -1;
+   }
+   if (Ptr != End)
+      return -1;
+
+   Ptr = First;
+   for (i = 0; i < Count; i++)
+   {
+      DeltaRecordS Rec;
+
+      GetRecord(Ptr, End, Rec);
+
+      auto    EntryIt     = mEntries.find(Rec.Key);
+      auto    TombstoneIt = mTombstones.find(Rec.Key);
+      EntryS *Local       = (EntryIt != mEntries.end()) ? EntryIt->second : nullptr;
+      EntryS *Stored;
+
+      if (Rec.Kind == DELTA_DELETE)
+      {
+         if (Local && Local->Creation > Rec.Time)
+            continue;
+         if (!Local && TombstoneIt != mTombstones.end() && TombstoneIt->second.DeletedAt >= Rec.Time)
+            continue;
+         if (Local)
+            Erase(Local);
+         AddTombstone(Rec.Key, Rec.Time);
+         Applied++;
+         continue;
+      }
+
+      if (Local)
+      {
+         time_t LocalExpires    = Local->HasExpiry ? Local->ExpiryPos->first : 0;
+         time_t IncomingExpires = Rec.Cookie.GetExpiresTime();
+         bool   Wins;
+
+         if (Rec.Time != Local->Creation)
+            Wins = Rec.Time > Local->Creation;
+         else if (IncomingExpires != LocalExpires)
+            Wins = IncomingExpires > LocalExpires;
+         else
+            Wins = CompareContent(Rec.Cookie, Local->Cookie) > 0;
+         if (!Wins)
+            continue;
+      }
+      else if (TombstoneIt != mTombstones.end() && TombstoneIt->second.DeletedAt >= Rec.Time)
+         continue;
+
+      if (Store(Rec.Cookie, Rec.Time, Now, &Stored))
+      {
+         // the sender checked the domain against its request host
+         if (Stored)
+         {
+            Stored->HostOnly = mPsl->IsPublicSuffix(Rec.Cookie.GetDomain());
+            Touched.push_back(Stored->DomainKey);
+         }
+         Applied++;
+      }
+   }
+
+   std::sort(Touched.begin(), Touched.end());
+   Touched.erase(std::unique(Touched.begin(), Touched.end()), Touched.end());
+   for (const std::string &DomainKey : Touched)
+      EnforceLimits(DomainKey, Now);
+
+   if (SenderSequence)
+      *SenderSequence = Sequence;
+   return Applied;
+}
+
+/*=****************************************************************************
+**
+** class CookieTableC
+**
+** DESCRIPTION : Column-oriented cookie table for whole-store sweeps.
+**
+**    Each attribute is a separate array (expiry, flag bits, domain id,
+**    name/value offsets into one string pool), so a scan over one
+**    predicate streams through a single dense column instead of touching
+**    every CookieC. Expiry and flag scans use AVX2 when compiled with
+**    -mavx2 and otherwise plain loops the compiler can vectorize.
+**
+**    Session cookies are stored with expiry INT64_MAX, so "expired at T
+**    and not a session cookie" is a single comparison. A cookie counts as
+**    expired once its expiry is <= T, as in CookieJarC::PurgeExpired.
+**                                                                           */
+/*=***************************************************************************/
+class CookieTableC
+{
+ public:
+   enum
+   {
+      FLAG_SECURE          = 0x01,
+      FLAG_HTTPONLY        = 0x02,
+      FLAG_SESSION         = 0x04,
+      FLAG_SAMESITE_STRICT = 0x08,
+      FLAG_SAMESITE_LAX    = 0x10,
+      FLAG_SAMESITE_NONE   = 0x20
+   };
+
+   CookieTableC();
+
+   size_t      Append(const CookieC &Cookie);
+   void        Clear();
+   size_t      Size() const;
+   size_t      FindExpired(int64_t Now, std::vector<uint32_t> &Rows) const;
+   size_t      PurgeExpired(int64_t Now);
+   size_t      CountFlags(uint8_t Mask, uint8_t Value) const;
+   void        CountPerDomain(std::vector<uint32_t> &Counts) const;
+   size_t      DomainCount() const;
+   const char *GetDomainName(uint32_t DomainId) const;
+   const char *GetName(size_t Row) const;
+   const char *GetValue(size_t Row) const;
+   int64_t     GetExpires(size_t Row) const;
+   uint8_t     GetFlags(size_t Row) const;
+   uint32_t    GetDomainId(size_t Row) const;
+
+ private:
+   void ExpiredMask(int64_t Now, std::vector<uint64_t> &Mask) const;
+   void CompactStrings();
+
+   std::vector<int64_t>                      mExpires;
+   std::vector<uint8_t>                      mFlags;
+   std::vector<uint32_t>                     mDomainIds;
+   std::vector<uint64_t>                     mNameOffsets; // 64-bit: the pool outgrows 4 GiB at ~1M 4 KB values
+   std::vector<uint64_t>                     mValueOffsets;
+   std::string                               mStrings; // NUL-terminated names and values
+   size_t                                    mDeadBytes;
+   std::vector<std::string>                  mDomainNames;
+   std::unordered_map<std::string, uint32_t> mDomainIndex;
+};
+
+/*=****************************************************************************
+**
+** CookieTableC::CookieTableC()
+**
+** DESCRIPTION : Constructor
+**
+** RETURN VALUE:
+**                                                                           */
+/*=***************************************************************************/
+CookieTableC::CookieTableC() :
+   mDeadBytes(0)
+{
+}
+
+/*=****************************************************************************
+**
+** size_t CookieTableC::Append(const CookieC &Cookie)
+**
+** DESCRIPTION : Add a row for <Cookie>. Domains are interned, so the
+**    domain column holds small ids.
+**
+** RETURN VALUE: row index
+**                                                                           */
+/*=***************************************************************************/
+size_t CookieTableC::Append(const CookieC &Cookie)
+{
+   const char *Name     = Cookie.GetName() ? Cookie.GetName() : "";
+   const char *Value    = Cookie.GetValue() ? Cookie.GetValue() : "";
+   const char *Domain   = Cookie.GetDomain() ? Cookie.GetDomain() : "";
+   const char *SameSite = Cookie.GetSameSite();
+   time_t      Expires  = Cookie.GetExpiresTime();
+   uint8_t     Flags    = 0;
+
+   if (Cookie.IsSecure())
+      Flags |= FLAG_SECURE;
+   if (Cookie.IsHttpOnly())
+      Flags |= FLAG_HTTPONLY;
+   if (Expires == 0)
+      Flags |= FLAG_SESSION;
+   if (SameSite && StrCaseEq(SameSite, "Strict"))
+      Flags |= FLAG_SAMESITE_STRICT;
+   else if (SameSite && StrCaseEq(SameSite, "Lax"))
+      Flags |= FLAG_SAMESITE_LAX;
+   else if (SameSite && StrCaseEq(SameSite, "None"))
+      Flags |= FLAG_SAMESITE_NONE;
+
+   auto DomainIt = mDomainIndex.try_emplace(Domain, (uint32_t) mDomainNames.size());
+   if (DomainIt.second)
+      mDomainNames.push_back(Domain);
+
+   mExpires.push_back(Expires == 0 ? INT64_MAX : (int64_t) Expires);
+   mFlags.push_back(Flags);
+   mDomainIds.push_back(DomainIt.first->second);
+   mNameOffsets.push_back(mStrings.size());
+   mStrings.append(Name, strlen(Name) + 1);
+   mValueOffsets.push_back(mStrings.size());
+   mStrings.append(Value, strlen(Value) + 1);
+
+   return mExpires.size() - 1;
+}
+
+/*=****************************************************************************
+**
+** void CookieTableC::Clear()
+**
+** DESCRIPTION :
+**
+** RETURN VALUE:
+**                                                                           */
+/*=***************************************************************************/
+void CookieTableC::Clear()
+{
+   mExpires.clear();
+   mFlags.clear();
+   mDomainIds.clear();
+   mNameOffsets.clear();
+   mValueOffsets.clear();
+   mStrings.clear();
+   mDeadBytes = 0;
+   mDomainNames.clear();
+   mDomainIndex.clear();
+}
+
+/*=****************************************************************************
+**
+** size_t CookieTableC::Size() const
+**
+** DESCRIPTION :
+**
+** RETURN VALUE: number of rows
+**                                                                           */
+/*=***************************************************************************/
+size_t CookieTableC::Size() const
+{
+   return mExpires.size();
+}
+
+/*=****************************************************************************
+**
+** void CookieTableC::ExpiredMask(int64_t Now, std::vector<uint64_t> &Mask)
+**    const
+**
+** DESCRIPTION : Set bit <Row> of <Mask> for every persistent cookie that
+**    expires at or before <Now>
+**
+** RETURN VALUE:
+**                                                                           */
+/*=***************************************************************************/
+void CookieTableC::ExpiredMask(int64_t Now, std::vector<uint64_t> &Mask) const
+{
+   const int64_t *Expires = mExpires.data();
+   size_t         Rows    = mExpires.size();
+   size_t         Row     = 0;
+
+   Mask.assign((Rows + 63) / 64, 0);
+
+#if defined(__AVX2__)
+   const __m256i NowVec = _mm256_set1_epi64x(Now);
+
+   for (; Row + 64 <= Rows; Row += 64)
+   {
+      uint64_t Word = 0;
+
+      for (size_t i = 0; i < 64; i += 4)
+      {
+         __m256i Vec = _mm256_loadu_si256((const __m256i *) (Expires + Row + i));
+         __m256i Gt  = _mm256_cmpgt_epi64(Vec, NowVec); // still valid
+
+         Word |= (uint64_t) (~_mm256_movemask_pd(_mm256_castsi256_pd(Gt)) & 0xF) << i;
+      }
+      Mask[Row / 64] = Word;
+   }
+#endif
+
+   for (; Row < Rows; Row += 64)
+   {
+      size_t   Count = std::min<size_t>(64, Rows - Row);
+      uint64_t Word  = 0;
+
+      for (size_t i = 0; i < Count; i++)
+         Word |= (uint64_t) (Expires[Row + i] <= Now) << i;
+      Mask[Row / 64] = Word;
+   }
+}
+
+/*=****************************************************************************
+**
+** size_t CookieTableC::FindExpired(int64_t Now, std::vector<uint32_t>
+**    &Rows) const
+**
+** DESCRIPTION : Collect the rows of persistent cookies that expire at or
+**    before <Now>
+**
+** RETURN VALUE: number of rows found
+**                                                                           */
+/*=***************************************************************************/
+size_t CookieTableC::FindExpired(int64_t Now, std::vector<uint32_t> &Rows) const
+{
+   std::vector<uint64_t> Mask;
+
+   Rows.clear();
+   ExpiredMask(Now, Mask);
+   for (size_t w = 0; w < Mask.size(); w++)
+   {
+      for (uint64_t Word = Mask[w]; Word; Word &= Word - 1)
+         Rows.push_back((uint32_t) (w * 64 + std::countr_zero(Word)));
+   }
+   return Rows.size();
+}
+
+/*=****************************************************************************
+**
+** size_t CookieTableC::PurgeExpired(int64_t Now)
+**
+** DESCRIPTION : Remove the rows of persistent cookies that expire at or
+**    before <Now>, keeping the order of the others. The string pool is
+**    compacted once more than half of it is unused.
+**
+** RETURN VALUE: number of rows removed
+**                                                                           */
+/*=***************************************************************************/
+size_t CookieTableC::PurgeExpired(int64_t Now)
+{
+   std::vector<uint64_t> Mask;
+   size_t                Rows = mExpires.size();
+   size_t                Kept = 0;
+
+   ExpiredMask(Now, Mask);
+   for (size_t Row = 0; Row < Rows; Row++)
+   {
+      if (Mask[Row / 64] & (1ULL << (Row % 64)))
+      {
+         mDeadBytes += mValueOffsets[Row] - mNameOffsets[Row];
+         mDeadBytes += strlen(&mStrings[mValueOffsets[Row]]) + 1;
+         continue;
+      }
+
+      mExpires[Kept]      = mExpires[Row];
+      mFlags[Kept]        = mFlags[Row];
+      mDomainIds[Kept]    = mDomainIds[Row];
+      mNameOffsets[Kept]  = mNameOffsets[Row];
+      mValueOffsets[Kept] = mValueOffsets[Row];
+      Kept++;
+   }
+
+   mExpires.resize(Kept);
+   mFlags.resize(Kept);
+   mDomainIds.resize(Kept);
+   mNameOffsets.resize(Kept);
+   mValueOffsets.resize(Kept);
+
+   if (mDeadBytes > mStrings.size() / 2)
+      CompactStrings();
+
+   return Rows - Kept;
+}
+
+/*=****************************************************************************
+**
+** void CookieTableC::CompactStrings()
+**
+** DESCRIPTION : Rewrite the string pool with only the live names/values
+**
+** RETURN VALUE:
+**                                                                           */
+/*=***************************************************************************/
+void CookieTableC::CompactStrings()
+{
+   std::string Strings;
+
+   Strings.reserve(mStrings.size() - mDeadBytes);
+   for (size_t Row = 0; Row < mExpires.size(); Row++)
+   {
+      const char *Name  = &mStrings[mNameOffsets[Row]];
+      const char *Value = &mStrings[mValueOffsets[Row]];
+
+      mNameOffsets[Row] = Strings.size();
+      Strings.append(Name, strlen(Name) + 1);
+      mValueOffsets[Row] = Strings.size();
+      Strings.append(Value, strlen(Value) + 1);
+   }
+   mStrings.swap(Strings);
+   mDeadBytes = 0;
+}
+
+/*=****************************************************************************
+**
+** size_t CookieTableC::CountFlags(uint8_t Mask, uint8_t Value) const
+**
+** DESCRIPTION : Count rows whose flags satisfy (Flags & Mask) == Value,
+**    e.g. CountFlags(FLAG_SECURE | FLAG_HTTPONLY, FLAG_SECURE) for secure
+**    cookies readable by scripts
+**
+** RETURN VALUE:
+**                                                                           */
+/*=***************************************************************************/
+size_t CookieTableC::CountFlags(uint8_t Mask, uint8_t Value) const
+{
+   const uint8_t *Flags = mFlags.data();
+   size_t         Rows  = mFlags.size();
+   size_t         Row   = 0;
+   size_t         Count = 0;
+
+#if defined(__AVX2__)
+   const __m256i MaskVec  = _mm256_set1_epi8((char) Mask);
+   const __m256i ValueVec = _mm256_set1_epi8((char) Value);
+
+   for (; Row + 32 <= Rows; Row += 32)
+   {
+      __m256i Vec = _mm256_loadu_si256((const __m256i *) (Flags + Row));
+      __m256i Eq  = _mm256_cmpeq_epi8(_mm256_and_si256(Vec, MaskVec), ValueVec);
+
+      Count += std::popcount((uint32_t) _mm256_movemask_epi8(Eq));
+   }
+#endif
+
+   for (; Row < Rows; Row++)
+      Count += ((Flags[Row] & Mask) == Value);
+   return Count;
+}
+
+/*=****************************************************************************
+**
+** void CookieTableC::CountPerDomain(std::vector<uint32_t> &Counts) const
+**
+** DESCRIPTION : Number of rows per domain, indexed by domain id
+**
+** RETURN VALUE:
+**                                                                           */
+/*=***************************************************************************/
+void CookieTableC::CountPerDomain(std::vector<uint32_t> &Counts) const
+{
+   Counts.assign(mDomainNames.size(), 0);
+   for (uint32_t DomainId : mDomainIds)
+      Counts[DomainId]++;
+}
+
+size_t CookieTableC::DomainCount() const
+{
+   return mDomainNames.size();
+}
+
+const char *CookieTableC::GetDomainName(uint32_t DomainId) const
+{
+   return mDomainNames[DomainId].c_str();
+}
+
+const char *CookieTableC::GetName(size_t Row) const
+{
+   return &mStrings[mNameOffsets[Row]];
+}
+
+const char *CookieTableC::GetValue(size_t Row) const
+{
+   return &mStrings[mValueOffsets[Row]];
+}
+
+int64_t CookieTableC::GetExpires(size_t Row) const
+{
+   return mExpires[Row];
+}
+
+uint8_t CookieTableC::GetFlags(size_t Row) const
+{
+   return mFlags[Row];
+}
+
+uint32_t CookieTableC::GetDomainId(size_t Row) const
+{
+   return mDomainIds[Row];
+}
+
+#ifndef _WIN32
+
+/*=****************************************************************************
+**
+** class SharedCookieStoreC
+**
+** DESCRIPTION : Cookie store living in a POSIX shared-memory segment, so
+**    pre-forked workers share one copy of every cookie.
+**
+**    All references inside the segment are 32-bit offsets from the segment
+**    base (0 = none), so every process may map it at a different address.
+**    Space is handed out in power-of-two blocks: from lock-free free lists
+**    (tagged heads against ABA) when possible, otherwise from an atomic
+**    bump pointer. Payloads and keys go back on their free list as soon as
+**    a cookie is replaced, deleted or found expired.
+**
+**    Records are slots chained per hash bucket and never leave their
+**    bucket. Everything in a record but its chain link (key, payload,
+**    flags) is published under a seqlock: writers make the sequence odd
+**    while they update, readers retry until they see the same even
+**    sequence before and after reading. A deleted or expired cookie frees
+**    its key and payload and leaves an empty slot, which the next new key
+**    hashing to the same bucket takes over. Blocks are only freed after
+**    the record stops pointing at them, which bumps its sequence, so
+**    readers compare the key and copy the payload inside the seqlock and
+**    retry if they were recycled under them.
+**
+**    Readers never block. Writers to the same bucket take turns on a lock
+**    bit in the bucket head; a worker killed while holding it blocks
+**    later writers of that bucket until the segment is recreated.
+**
+**    Expired cookies are not returned by Get(). Set() frees the expired
+**    cookies it passes in the bucket it writes to, and PurgeExpired()
+**    sweeps the whole segment (Set() also runs it once when full).
+**                                                                           */
+/*=***************************************************************************/
+class SharedCookieStoreC
+{
+ public:
+   static SharedCookieStoreC *Create(const char *ShmName, size_t Size, uint32_t BucketCount = 4096);
+   static SharedCookieStoreC *Open(const char *ShmName);
+   static bool                Unlink(const char *ShmName);
+
+   ~SharedCookieStoreC();
+
+   bool     Set(const CookieC &Cookie);
+   CookieC *Get(const char *Name, const char *Domain, const char *Path) const;
+   size_t   PurgeExpired(time_t Now);
+   size_t   Count() const;
+   size_t   BytesUsed() const;
+   size_t   BytesFree() const;
+
+ private:
+   enum
+   {
+      MAGIC = 0x43534832, // "CSH2"
+
+      FLAG_SECURE   = 0x01,
+      FLAG_HTTPONLY = 0x02,
+
+      KEY_HAS_PATH      = 0x01,
+      DATA_HAS_EXPIRES  = 0x01,
+      DATA_HAS_SAMESITE = 0x02,
+      DATA_HEADER       = 9, // <int64 expiry><flags>
+
+      BUCKET_LOCKED = 0x01, // record offsets are 8-byte aligned
+
+      MIN_BLOCK_SHIFT = 5, // smallest block, 32 bytes including its header
+      BLOCK_CLASSES   = 27, // up to 2 GiB
+      BLOCK_HEADER    = 8,
+
+      ATTACH_TIMEOUT_MS = 1000
+   };
+
+   struct HeaderS
+   {
+      std::atomic<uint32_t> Magic;
+      uint32_t              Size;
+      uint32_t              BucketCount;
+      std::atomic<uint32_t> AllocOffset;
+      std::atomic<uint32_t> RecordCount;
+      std::atomic<uint64_t> FreeBytes;
+      std::atomic<uint64_t> FreeLists[BLOCK_CLASSES]; // <tag:32><block offset:32>
+      // followed by BucketCount std::atomic<uint32_t> bucket heads
+   };
+
+   // every allocation starts with one; the data follows at +BLOCK_HEADER
+   struct BlockS
+   {
+      uint32_t              Class; // fixed once the block is carved out
+      std::atomic<uint32_t> Len;   // bytes of data in use
+      std::atomic<uint32_t> NextFree; // overlays the data while on a free list
+   };
+
+   struct RecordS
+   {
+      std::atomic<uint32_t> Sequence;   // seqlock, odd while being written
+      std::atomic<uint32_t> KeyOffset;  // guarded by Sequence, 0 = empty slot
+      std::atomic<uint32_t> Hash;       // guarded by Sequence
+      std::atomic<uint32_t> DataOffset; // guarded by Sequence
+      std::atomic<uint32_t> Flags;      // guarded by Sequence
+      uint32_t              Next;       // immutable once published
+   };
+
+   static_assert(std::atomic<uint32_t>::is_always_lock_free, "shared atomics must be lock-free");
+   static_assert(std::atomic<uint64_t>::is_always_lock_free, "shared atomics must be lock-free");
+
+   SharedCookieStoreC(unsigned char *Base, size_t MapSize);
+
+   static SharedCookieStoreC *Map(int Fd, size_t Size, bool Initialize, uint32_t BucketCount);
+
+   HeaderS               *Header() const;
+   std::atomic<uint32_t> *Buckets() const;
+   RecordS               *Record(uint32_t Offset) const;
+   BlockS                *Block(uint32_t DataOffset) const;
+   uint32_t               Alloc(size_t Len);
+   void                   Release(uint32_t DataOffset);
+   uint32_t               StoreData(const CookieC &Cookie, time_t Expires);
+   bool                   KeyEquals(uint32_t KeyOffset, const std::string &Key) const;
+   bool                   ReadRecord(const RecordS *Rec, uint32_t Hash, const std::string &Key, std::string &Data,
+                                     uint32_t *Flags) const;
+   bool                   IsExpired(uint32_t DataOffset, time_t Now) const;
+   void                   Publish(RecordS *Rec, uint32_t KeyOffset, uint32_t Hash, uint32_t DataOffset,
+                                  uint32_t Flags);
+   void                   EmptySlot(RecordS *Rec);
+   size_t                 PurgeBucket(std::atomic<uint32_t> *Bucket, time_t Now);
+   bool                   Update(std::atomic<uint32_t> *Bucket, const std::string &Key, uint32_t Hash, time_t Now,
+                                 bool Delete, uint32_t *DataOffset, uint32_t Flags);
+
+   static void        LockBucket(std::atomic<uint32_t> *Bucket);
+   static void        UnlockBucket(std::atomic<uint32_t> *Bucket);
+   static uint32_t    HashKey(const char *Name, const char *Domain, const char *Path);
+   static std::string MakeKey(const char *Name, const char *Domain, const char *Path);
+
+   unsigned char *mBase;
+   size_t         mMapSize;
+};
+
+/*=****************************************************************************
+**
+** SharedCookieStoreC *SharedCookieStoreC::Create(const char *ShmName,
+**    size_t Size, uint32_t BucketCount)
+**
+** DESCRIPTION : Create the named segment, or attach to it if another
+**    process created it first. Call before forking the workers, or from
+**    every worker with the same name.
+**
+** RETURN VALUE: new store, nullptr on error. Caller must delete.
+**                                                                           */
+/*=***************************************************************************/
+SharedCookieStoreC *SharedCookieStoreC::Create(const char *ShmName, size_t Size, uint32_t BucketCount)
+{
+   int                 Fd;
+   SharedCookieStoreC *Store;
+
+   if (IsEmptyString(ShmName) || BucketCount == 0 || Size > UINT32_MAX ||
+       Size < sizeof(HeaderS) + BucketCount * sizeof(uint32_t) + sizeof(RecordS))
+      return nullptr;
+
+   Fd = shm_open(ShmName, O_RDWR | O_CREAT | O_EXCL, 0600);
+   if (Fd < 0)
+      return (errno == EEXIST) ? Open(ShmName) : nullptr;
+
+   if (ftruncate(Fd, (off_t) Size) != 0)
+   {
+      close(Fd);
+      shm_unlink(ShmName);
+      return nullptr;
+   }
+
+   Store = Map(Fd, Size, true, BucketCount);
+   close(Fd);
+   if (!Store)
+      shm_unlink(ShmName);
+   return Store;
+}
+
+/*=****************************************************************************
+**
+** SharedCookieStoreC *SharedCookieStoreC::Open(const char *ShmName)
+**
+** DESCRIPTION : Attach to an existing segment. Waits up to
+**    ATTACH_TIMEOUT_MS for the creator to size and initialize it.
+**
+** RETURN VALUE: new store, nullptr on error, on timeout (the creator died
+**    half way) or if the segment is too small to be a store. Caller must
+**    delete.
+**                                                                           */
+/*=***************************************************************************/
+SharedCookieStoreC *SharedCookieStoreC::Open(const char *ShmName)
+{
+   int                 Fd;
+   int                 Waited = 0;
+   struct stat         St;
+   SharedCookieStoreC *Store;
+
+   if (IsEmptyString(ShmName))
+      return nullptr;
+
+   Fd = shm_open(ShmName, O_RDWR, 0600);
+   if (Fd < 0)
+      return nullptr;
+
+   // the creator may not have sized the segment yet
+   for (;;)
+   {
+      if (fstat(Fd, &St) != 0)
+      {
+         close(Fd);
+         return nullptr;
+      }
+      if (St.st_size != 0 || Waited++ >= ATTACH_TIMEOUT_MS)
+         break;
+      usleep(1000);
+   }
+
+   if ((size_t) St.st_size < sizeof(HeaderS) || (uint64_t) St.st_size > UINT32_MAX)
+   {
+      close(Fd);
+      return nullptr;
+   }
+
+   Store = Map(Fd, (size_t) St.st_size, false, 0);
+   close(Fd);
+   return Store;
+}
+
+/*=****************************************************************************
+**
+** bool SharedCookieStoreC::Unlink(const char *ShmName)
+**
+** DESCRIPTION : Remove the segment name. Processes that have it mapped keep
+**    using it until they delete their store.
+**
+** RETURN VALUE:
+**                                                                           */
+/*=***************************************************************************/
+bool SharedCookieStoreC::Unlink(const char *ShmName)
+{
+   return (shm_unlink(ShmName) == 0);
+}
+
+/*=****************************************************************************
+**
+** SharedCookieStoreC *SharedCookieStoreC::Map(int Fd, size_t Size, bool
+**    Initialize, uint32_t BucketCount)
+**
+** DESCRIPTION : mmap the segment and, for the creator, lay out the header
+**    and bucket array. The magic is stored last so attaching processes only
+**    start using the segment once it is complete; they give up after
+**    ATTACH_TIMEOUT_MS.
+**
+** RETURN VALUE: new store, nullptr on error
+**                                                                           */
+/*=***************************************************************************/
+SharedCookieStoreC *SharedCookieStoreC::Map(int Fd, size_t Size, bool Initialize, uint32_t BucketCount)
+{
+   void    *Base;
+   HeaderS *Hdr;
+   int      Waited = 0;
+
+   Base = mmap(nullptr, Size, PROT_READ | PROT_WRITE, MAP_SHARED, Fd, 0);
+   if (Base == MAP_FAILED)
+      return nullptr;
+
+   Hdr = (HeaderS *) Base;
+   if (Initialize)
+   {
+      // ftruncate zero-fills, so the bucket heads and free lists are empty
+      Hdr->Size        = (uint32_t) Size;
+      Hdr->BucketCount = BucketCount;
+      Hdr->AllocOffset.store((uint32_t) ((sizeof(HeaderS) + BucketCount * sizeof(uint32_t) + 7) & ~7),
+                             std::memory_order_relaxed);
+      Hdr->RecordCount.store(0, std::memory_order_relaxed);
+      Hdr->Magic.store(MAGIC, std::memory_order_release);
+   }
+   else
+   {
+      while (Hdr->Magic.load(std::memory_order_acquire) != MAGIC)
+      {
+         if (Waited++ >= ATTACH_TIMEOUT_MS)
+         {
+            munmap(Base, Size);
+            return nullptr;
+         }
+         usleep(1000);
+      }
+
+      if (Hdr->Size != Size || Hdr->BucketCount == 0 ||
+          sizeof(HeaderS) + (uint64_t) Hdr->BucketCount * sizeof(uint32_t) > Size)
+      {
+         munmap(Base, Size);
+         return nullptr;
+      }
+   }
+
+   return new SharedCookieStoreC((unsigned char *) Base, Size);
+}
+
+/*=****************************************************************************
+**
+** SharedCookieStoreC::SharedCookieStoreC(unsigned char *Base, size_t
+**    MapSize)
+**
+** DESCRIPTION : Constructor
+**
+** RETURN VALUE:
+**                                                                           */
+/*=***************************************************************************/
+SharedCookieStoreC::SharedCookieStoreC(unsigned char *Base, size_t MapSize) :
+   mBase(Base),
+   mMapSize(MapSize)
+{
+}
+
+/*=****************************************************************************
+**
+** SharedCookieStoreC::~SharedCookieStoreC()
+**
+** DESCRIPTION : Destructor, unmaps the segment in this process only
+**
+** RETURN VALUE:
+**                                                                           */
+/*=***************************************************************************/
+SharedCookieStoreC::~SharedCookieStoreC()
+{
+   munmap(mBase, mMapSize);
+}
+
+SharedCookieStoreC::HeaderS *SharedCookieStoreC::Header() const
+{
+   return (HeaderS *) mBase;
+}
+
+std::atomic<uint32_t> *SharedCookieStoreC::Buckets() const
+{
+   return (std::atomic<uint32_t> *) (mBase + sizeof(HeaderS));
+}
+
+SharedCookieStoreC::RecordS *SharedCookieStoreC::Record(uint32_t Offset) const
+{
+   return Offset ? (RecordS *) (mBase + Offset) : nullptr;
+}
+
+SharedCookieStoreC::BlockS *SharedCookieStoreC::Block(uint32_t DataOffset) const
+{
+   return (BlockS *) (mBase + DataOffset - BLOCK_HEADER);
+}
+
+/*=****************************************************************************
+**
+** uint32_t SharedCookieStoreC::Alloc(size_t Len)
+**
+** DESCRIPTION : Lock-free allocation of <Len> bytes, 8-byte aligned.
+**    Pops a block of the matching power-of-two class off its free list,
+**    or carves a new one from the bump pointer.
+**
+** RETURN VALUE: offset of the data, 0 when the segment is full
+**                                                                           */
+/*=***************************************************************************/
+uint32_t SharedCookieStoreC::Alloc(size_t Len)
+{
+   HeaderS  *Hdr   = Header();
+   uint32_t  Class = 0;
+   uint64_t  Head;
+   uint32_t  Offset;
+   uint32_t  NewOffset;
+   BlockS   *Blk;
+
+   while (Class < BLOCK_CLASSES && ((size_t) 1 << (Class + MIN_BLOCK_SHIFT)) < Len + BLOCK_HEADER)
+      Class++;
+   if (Class == BLOCK_CLASSES)
+      return 0;
+
+   // the tag in the upper half changes on every pop, so a head that was
+   // popped and pushed back in between cannot be mistaken for the old one
+   Head = Hdr->FreeLists[Class].load(std::memory_order_acquire);
+   while ((uint32_t) Head)
+   {
+      Blk = (BlockS *) (mBase + (uint32_t) Head);
+      uint64_t Next = (((Head >> 32) + 1) << 32) | Blk->NextFree.load(std::memory_order_relaxed);
+
+      if (Hdr->FreeLists[Class].compare_exchange_weak(Head, Next, std::memory_order_acquire,
+                                                       std::memory_order_acquire))
+      {
+         Hdr->FreeBytes.fetch_sub((uint64_t) 1 << (Class + MIN_BLOCK_SHIFT), std::memory_order_relaxed);
+         Blk->Len.store((uint32_t) Len, std::memory_order_relaxed);
+         return (uint32_t) Head + BLOCK_HEADER;
+      }
+   }
+
+   Offset = Hdr->AllocOffset.load(std::memory_order_relaxed);
+   do
+   {
+      if (((uint64_t) 1 << (Class + MIN_BLOCK_SHIFT)) > Hdr->Size - Offset)
+         return 0;
+      NewOffset = Offset + ((uint32_t) 1 << (Class + MIN_BLOCK_SHIFT));
+   } while (!Hdr->AllocOffset.compare_exchange_weak(Offset, NewOffset, std::memory_order_relaxed));
+
+   Blk        = (BlockS *) (mBase + Offset);
+   Blk->Class = Class;
+   Blk->Len.store((uint32_t) Len, std::memory_order_relaxed);
+   return Offset + BLOCK_HEADER;
+}
+
+/*=****************************************************************************
+**
+** void SharedCookieStoreC::Release(uint32_t DataOffset)
+**
+** DESCRIPTION : Push a block from Alloc() back on its free list. The
+**    caller must make sure no record points at it any more.
+**
+** RETURN VALUE:
+**                                                                           */
+/*=***************************************************************************/
+void SharedCookieStoreC::Release(uint32_t DataOffset)
+{
+   HeaderS *Hdr = Header();
+   BlockS  *Blk;
+   uint64_t Head;
+   uint64_t NewHead;
+
+   if (!DataOffset)
+      return;
+
+   Blk  = Block(DataOffset);
+   Head = Hdr->FreeLists[Blk->Class].load(std::memory_order_relaxed);
+   do
+   {
+      Blk->NextFree.store((uint32_t) Head, std::memory_order_relaxed);
+      NewHead = (Head & 0xFFFFFFFF00000000ULL) | (DataOffset - BLOCK_HEADER);
+   } while (!Hdr->FreeLists[Blk->Class].compare_exchange_weak(Head, NewHead, std::memory_order_release,
+                                                               std::memory_order_relaxed));
+
+   Hdr->FreeBytes.fetch_add((uint64_t) 1 << (Blk->Class + MIN_BLOCK_SHIFT), std::memory_order_relaxed);
+}
+
+/*=****************************************************************************
+**
+** uint32_t SharedCookieStoreC::HashKey(const char *Name, const char *Domain,
+**    const char *Path)
+**
+** DESCRIPTION :
+**
+** RETURN VALUE:
+**                                                                           */
+/*=***************************************************************************/
+uint32_t SharedCookieStoreC::HashKey(const char *Name, const char *Domain, const char *Path)
+{
+   uint64_t Hash;
+
+   Hash = HashBytes(Name, strlen(Name) + 1);
+   Hash = HashBytes(Domain, strlen(Domain) + 1, Hash);
+   if (Path)
+      Hash = HashBytes(Path, strlen(Path), Hash);
+   return (uint32_t) (Hash ^ (Hash >> 32));
+}
+
+/*=****************************************************************************
+**
+** std::string SharedCookieStoreC::MakeKey(const char *Name, const char
+**    *Domain, const char *Path)
+**
+** DESCRIPTION : Key block contents: <flags><name>\0<domain>\0<path>\0
+**
+** RETURN VALUE:
+**                                                                           */
+/*=***************************************************************************/
+std::string SharedCookieStoreC::MakeKey(const char *Name, const char *Domain, const char *Path)
+{
+   std::string Key(1, (char) (Path ? KEY_HAS_PATH : 0));
+
+   Key.append(Name).push_back('\0');
+   Key.append(Domain).push_back('\0');
+   Key.append(Path ? Path : "").push_back('\0');
+   return Key;
+}
+
+/*=****************************************************************************
+**
+** bool SharedCookieStoreC::KeyEquals(uint32_t KeyOffset, const std::string
+**    &Key) const
+**
+** DESCRIPTION : Compare a key block with <Key> from MakeKey. Only reads
+**    inside the block, so it is safe on a block being recycled; the
+**    caller's seqlock check discards such a result.
+**
+** RETURN VALUE:
+**                                                                           */
+/*=***************************************************************************/
+bool SharedCookieStoreC::KeyEquals(uint32_t KeyOffset, const std::string &Key) const
+{
+   const BlockS *Blk = Block(KeyOffset);
+   size_t        Cap = ((size_t) 1 << (Blk->Class + MIN_BLOCK_SHIFT)) - BLOCK_HEADER;
+
+   return Blk->Len.load(std::memory_order_relaxed) == Key.size() && Key.size() <= Cap &&
+          memcmp(mBase + KeyOffset, Key.data(), Key.size()) == 0;
+}
+
+/*=****************************************************************************
+**
+** bool SharedCookieStoreC::ReadRecord(const RecordS *Rec, uint32_t Hash,
+**    const std::string &Key, std::string &Data, uint32_t *Flags) const
+**
+** DESCRIPTION : Seqlock read of a record: if it holds <Key>, copy its
+**    payload to <Data> and its flags to <Flags>. Lock-free; retries only
+**    while a writer is updating the record.
+**
+** RETURN VALUE: whether the record holds <Key>
+**                                                                           */
+/*=***************************************************************************/
+bool SharedCookieStoreC::ReadRecord(const RecordS *Rec, uint32_t Hash, const std::string &Key, std::string &Data,
+                                    uint32_t *Flags) const
+{
+   uint32_t Seq1, Seq2;
+   uint32_t KeyOffset;
+   uint32_t DataOffset;
+   bool     Match;
+
+   do
+   {
+      Seq1  = Rec->Sequence.load(std::memory_order_acquire);
+      Match = false;
+      Data.clear();
+
+      KeyOffset = Rec->KeyOffset.load(std::memory_order_relaxed);
+      if (!(Seq1 & 1) && KeyOffset && Rec->Hash.load(std::memory_order_relaxed) == Hash && KeyEquals(KeyOffset, Key))
+      {
+         Match      = true;
+         DataOffset = Rec->DataOffset.load(std::memory_order_relaxed);
+         *Flags     = Rec->Flags.load(std::memory_order_relaxed);
+         if (DataOffset)
+         {
+            const BlockS *Blk = Block(DataOffset);
+            size_t        Cap = ((size_t) 1 << (Blk->Class + MIN_BLOCK_SHIFT)) - BLOCK_HEADER;
+
+            // Len may be torn by a concurrent reuse; bound it, the sequence
+            // check below throws the copy away in that case
+            Data.assign((const char *) mBase + DataOffset,
+                        std::min<size_t>(Blk->Len.load(std::memory_order_relaxed), Cap));
+         }
+      }
+
+      std::atomic_thread_fence(std::memory_order_acquire);
+      Seq2 = Rec->Sequence.load(std::memory_order_relaxed);
+   } while ((Seq1 & 1) || Seq1 != Seq2);
+
+   return Match;
+}
+
+/*=****************************************************************************
+**
+** bool SharedCookieStoreC::IsExpired(uint32_t DataOffset, time_t Now) const
+**
+** DESCRIPTION : Whether the payload at <DataOffset> has an expiry at or
+**    before <Now>. Writers only, with the bucket locked.
+**
+** RETURN VALUE:
+**                                                                           */
+/*=***************************************************************************/
+bool SharedCookieStoreC::IsExpired(uint32_t DataOffset, time_t Now) const
+{
+   int64_t Expires;
+
+   if (!DataOffset)
+      return false;
+   memcpy(&Expires, mBase + DataOffset, sizeof(Expires));
+   return Expires != 0 && Expires <= (int64_t) Now;
+}
+
+/*=****************************************************************************
+**
+** void SharedCookieStoreC::LockBucket(std::atomic<uint32_t> *Bucket)
+**
+** DESCRIPTION : Serialize writers of one bucket. Readers ignore the lock
+**    bit.
+**
+** RETURN VALUE:
+**                                                                           */
+/*=***************************************************************************/
+void SharedCookieStoreC::LockBucket(std::atomic<uint32_t> *Bucket)
+{
+   while (Bucket->fetch_or(BUCKET_LOCKED, std::memory_order_acquire) & BUCKET_LOCKED)
+      std::this_thread::yield();
+}
+
+void SharedCookieStoreC::UnlockBucket(std::atomic<uint32_t> *Bucket)
+{
+   Bucket->fetch_and(~(uint32_t) BUCKET_LOCKED, std::memory_order_release);
+}
+
+/*=****************************************************************************
+**
+** uint32_t SharedCookieStoreC::StoreData(const CookieC &Cookie, time_t
+**    Expires)
+**
+** DESCRIPTION : Copy the mutable fields of <Cookie> into a new, immutable
+**    payload: <int64 expires><flags><value>\0<expires>\0<samesite>\0. The
+**    parsed expiry (0 for none) lets readers and sweeps check it without
+**    parsing the date.
+**
+** RETURN VALUE: payload offset, 0 when the segment is full
+**                                                                           */
+/*=***************************************************************************/
+uint32_t SharedCookieStoreC::StoreData(const CookieC &Cookie, time_t Expires)
+{
+   const char *Value       = Cookie.GetValue() ? Cookie.GetValue() : "";
+   const char *ExpiresStr  = Cookie.GetExpires() ? Cookie.GetExpires() : "";
+   const char *SameSite    = Cookie.GetSameSite() ? Cookie.GetSameSite() : "";
+   size_t      ValueLen    = strlen(Value) + 1;
+   size_t      ExpiresLen  = strlen(ExpiresStr) + 1;
+   size_t      SameSiteLen = strlen(SameSite) + 1;
+   int64_t     Expiry      = (int64_t) Expires;
+   uint32_t    Offset;
+   char       *Ptr;
+
+   Offset = Alloc(DATA_HEADER + ValueLen + ExpiresLen + SameSiteLen);
+   if (!Offset)
+      return 0;
+
+   Ptr = (char *) mBase + Offset;
+   memcpy(Ptr, &Expiry, sizeof(Expiry));
+   Ptr += sizeof(Expiry);
+   *Ptr++ = (char) ((Cookie.GetExpires() ? DATA_HAS_EXPIRES : 0) | (Cookie.GetSameSite() ? DATA_HAS_SAMESITE : 0));
+   memcpy(Ptr, Value, ValueLen);
+   Ptr += ValueLen;
+   memcpy(Ptr, ExpiresStr, ExpiresLen);
+   Ptr += ExpiresLen;
+   memcpy(Ptr, SameSite, SameSiteLen);
+
+   return Offset;
+}
+
+/*=****************************************************************************
+**
+** void SharedCookieStoreC::Publish(RecordS *Rec, uint32_t KeyOffset,
+**    uint32_t Hash, uint32_t DataOffset, uint32_t Flags)
+**
+** DESCRIPTION : Seqlock write of a record. The caller holds the bucket
+**    lock, so there is only one writer.
+**
+** RETURN VALUE:
+**                                                                           */
+/*=***************************************************************************/
+void SharedCookieStoreC::Publish(RecordS *Rec, uint32_t KeyOffset, uint32_t Hash, uint32_t DataOffset,
+                                 uint32_t Flags)
+{
+   uint32_t Seq = Rec->Sequence.load(std::memory_order_relaxed);
+
+   Rec->Sequence.store(Seq + 1, std::memory_order_relaxed);
+   std::atomic_thread_fence(std::memory_order_release);
+
+   Rec->KeyOffset.store(KeyOffset, std::memory_order_relaxed);
+   Rec->Hash.store(Hash, std::memory_order_relaxed);
+   Rec->DataOffset.store(DataOffset, std::memory_order_relaxed);
+   Rec->Flags.store(Flags, std::memory_order_relaxed);
+
+   Rec->Sequence.store(Seq + 2, std::memory_order_release);
+}
+
+/*=****************************************************************************
+**
+** void SharedCookieStoreC::EmptySlot(RecordS *Rec)
+**
+** DESCRIPTION : Drop the cookie in <Rec> and free its key and payload. The
+**    record stays in its bucket for the next new key. Bucket locked.
+**
+** RETURN VALUE:
+**                                                                           */
+/*=***************************************************************************/
+void SharedCookieStoreC::EmptySlot(RecordS *Rec)
+{
+   uint32_t KeyOffset  = Rec->KeyOffset.load(std::memory_order_relaxed);
+   uint32_t DataOffset = Rec->DataOffset.load(std::memory_order_relaxed);
+
+   Publish(Rec, 0, 0, 0, 0);
+   Release(DataOffset);
+   Release(KeyOffset);
+   Header()->RecordCount.fetch_sub(1, std::memory_order_relaxed);
+}
+
+/*=****************************************************************************
+**
+** size_t SharedCookieStoreC::PurgeBucket(std::atomic<uint32_t> *Bucket,
+**    time_t Now)
+**
+** DESCRIPTION : Empty the slots of the cookies in <Bucket> that expired at
+**    or before <Now>
+**
+** RETURN VALUE: number of cookies removed
+**                                                                           */
+/*=***************************************************************************/
+size_t SharedCookieStoreC::PurgeBucket(std::atomic<uint32_t> *Bucket, time_t Now)
+{
+   size_t   Purged = 0;
+   RecordS *Rec;
+
+   if ((Bucket->load(std::memory_order_relaxed) & ~(uint32_t) BUCKET_LOCKED) == 0)
+      return 0;
+
+   LockBucket(Bucket);
+   for (uint32_t Offset = Bucket->load(std::memory_order_relaxed) & ~(uint32_t) BUCKET_LOCKED; Offset;
+        Offset = Rec->Next)
+   {
+      Rec = Record(Offset);
+      if (Rec->KeyOffset.load(std::memory_order_relaxed) &&
+          IsExpired(Rec->DataOffset.load(std::memory_order_relaxed), Now))
+      {
+         EmptySlot(Rec);
+         Purged++;
+      }
+   }
+   UnlockBucket(Bucket);
+
+   return Purged;
+}
+
+/*=****************************************************************************
+**
+** size_t SharedCookieStoreC::PurgeExpired(time_t Now)
+**
+** DESCRIPTION : Free the keys and payloads of all cookies that expired at
+**    or before <Now>. Safe to run from any worker at any time.
+**
+** RETURN VALUE: number of cookies removed
+**                                                                           */
+/*=***************************************************************************/
+size_t SharedCookieStoreC::PurgeExpired(time_t Now)
+{
+   size_t Purged = 0;
+
+   for (uint32_t i = 0; i < Header()->BucketCount; i++)
+      Purged += PurgeBucket(&Buckets()[i], Now);
+   return Purged;
+}
+
+/*=****************************************************************************
+**
+** bool SharedCookieStoreC::Set(const CookieC &Cookie)
+**
+** DESCRIPTION : Insert or replace a cookie, visible to all workers as soon
+**    as this returns. A cookie whose expiry parses and lies in the past
+**    deletes the stored one, as for a Set-Cookie header; an Expires that
+**    cannot be parsed is ignored (RFC 6265 5.2.1), as in CookieJarC.
+**
+**    Expired cookies met in the same bucket are freed on the way. If the
+**    segment is full, the whole segment is swept once and the insert
+**    retried.
+**
+** RETURN VALUE: false when the cookie has no name/domain or the segment is
+**    full
+**                                                                           */
+/*=***************************************************************************/
+bool SharedCookieStoreC::Set(const CookieC &Cookie)
+{
+   const char            *Name    = Cookie.GetName();
+   const char            *Domain  = Cookie.GetDomain();
+   const char            *Path    = Cookie.GetPath();
+   time_t                 Expires = Cookie.GetExpiresTime();
+   time_t                 Now     = time(nullptr);
+   bool                   Delete  = (Expires != 0 && Expires <= Now);
+   bool                   Swept   = false;
+   std::atomic<uint32_t> *Bucket;
+   std::string            Key;
+   uint32_t               Hash;
+   uint32_t               Flags;
+   uint32_t               DataOffset = 0;
+
+   if (IsEmptyString(Name) || IsEmptyString(Domain))
+      return false;
+
+   Flags  = (Cookie.IsSecure() ? FLAG_SECURE : 0) | (Cookie.IsHttpOnly() ? FLAG_HTTPONLY : 0);
+   Key    = MakeKey(Name, Domain, Path);
+   Hash   = HashKey(Name, Domain, Path);
+   Bucket = &Buckets()[Hash % Header()->BucketCount];
+
+   for (;;)
+   {
+      bool Stored = true;
+
+      if (!Delete && !DataOffset)
+         DataOffset = StoreData(Cookie, Expires);
+
+      if (Delete || DataOffset)
+      {
+         LockBucket(Bucket);
+         Stored = Update(Bucket, Key, Hash, Now, Delete, &DataOffset, Flags);
+         UnlockBucket(Bucket);
+         if (Stored)
+            break;
+      }
+
+      // full: sweep the segment once and retry
+      if (Swept || PurgeExpired(Now) == 0)
+      {
+         Release(DataOffset);
+         return false;
+      }
+      Swept = true;
+   }
+
+   Release(DataOffset);
+   return true;
+}
+
+/*=****************************************************************************
+**
+** bool SharedCookieStoreC::Update(std::atomic<uint32_t> *Bucket, const
+**    std::string &Key, uint32_t Hash, time_t Now, bool Delete, uint32_t
+**    *DataOffset, uint32_t Flags)
+**
+** DESCRIPTION : The locked part of Set(): replace, delete or insert <Key>
+**    in <Bucket>, freeing expired cookies met on the way. A new key takes
+**    the first empty slot of the bucket or a new record.
+**
+** RETURN VALUE: false if a new key did not fit. <DataOffset> is set to 0
+**    when the payload was published, otherwise the caller still owns it.
+**                                                                           */
+/*=***************************************************************************/
+bool SharedCookieStoreC::Update(std::atomic<uint32_t> *Bucket, const std::string &Key, uint32_t Hash, time_t Now,
+                                bool Delete, uint32_t *DataOffset, uint32_t Flags)
+{
+   uint32_t Head = Bucket->load(std::memory_order_relaxed) & ~(uint32_t) BUCKET_LOCKED;
+   uint32_t KeyOffset;
+   RecordS *Rec;
+   RecordS *Empty = nullptr;
+
+   for (uint32_t Offset = Head; Offset; Offset = Rec->Next)
+   {
+      uint32_t RecKey;
+
+      Rec    = Record(Offset);
+      RecKey = Rec->KeyOffset.load(std::memory_order_relaxed);
+      if (RecKey && Rec->Hash.load(std::memory_order_relaxed) == Hash && KeyEquals(RecKey, Key))
+      {
+         if (Delete)
+            EmptySlot(Rec);
+         else
+         {
+            uint32_t Old = Rec->DataOffset.load(std::memory_order_relaxed);
+
+            Publish(Rec, RecKey, Hash, *DataOffset, Flags);
+            Release(Old);
+            *DataOffset = 0;
+         }
+         return true;
+      }
+
+      if (RecKey && IsExpired(Rec->DataOffset.load(std::memory_order_relaxed), Now))
+      {
+         EmptySlot(Rec);
+         RecKey = 0;
+      }
+      if (!RecKey && !Empty)
+         Empty = Rec;
+   }
+
+   if (Delete)
+      return true; // nothing to delete
+
+   KeyOffset = Alloc(Key.size());
+   if (!KeyOffset)
+      return false;
+   memcpy(mBase + KeyOffset, Key.data(), Key.size());
+
+   if (!Empty)
+   {
+      uint32_t RecOffset = Alloc(sizeof(RecordS));
+
+      if (!RecOffset)
+      {
+         Release(KeyOffset);
+         return false;
+      }
+
+      // not reachable by readers until pushed, so no seqlock needed yet
+      Empty = (RecordS *) (mBase + RecOffset);
+      Empty->Sequence.store(0, std::memory_order_relaxed);
+      Empty->KeyOffset.store(0, std::memory_order_relaxed);
+      Empty->Next = Head;
+      Bucket->store(RecOffset | BUCKET_LOCKED, std::memory_order_release);
+   }
+
+   Publish(Empty, KeyOffset, Hash, *DataOffset, Flags);
+   Header()->RecordCount.fetch_add(1, std::memory_order_relaxed);
+   *DataOffset = 0;
+   return true;
+}
+
+/*=****************************************************************************
+**
+** CookieC *SharedCookieStoreC::Get(const char *Name, const char *Domain,
+**    const char *Path) const
+**
+** DESCRIPTION : Look up a cookie by its key. Lock-free; retries only while
+**    a writer is updating a record it reads. Expired cookies are not
+**    returned, even before a sweep removes them.
+**
+** RETURN VALUE: copy of the cookie, nullptr if not found. Caller must
+**    delete.
+**                                                                           */
+/*=***************************************************************************/
+CookieC *SharedCookieStoreC::Get(const char *Name, const char *Domain, const char *Path) const
+{
+   uint32_t    Hash;
+   uint32_t    Flags = 0;
+   bool        Found = false;
+   int64_t     Expires;
+   RecordS    *Rec;
+   CookieC    *C;
+   std::string Key;
+   std::string Data;
+   const char *Value, *ExpiresStr, *SameSite;
+
+   if (IsEmptyString(Name) || IsEmptyString(Domain))
+      return nullptr;
+
+   Key  = MakeKey(Name, Domain, Path);
+   Hash = HashKey(Name, Domain, Path);
+   for (uint32_t Offset = Buckets()[Hash % Header()->BucketCount].load(std::memory_order_acquire) &
+                          ~(uint32_t) BUCKET_LOCKED;
+        Offset && !Found; Offset = Rec->Next)
+   {
+      Rec   = Record(Offset);
+      Found = ReadRecord(Rec, Hash, Key, Data, &Flags);
+   }
+   if (!Found || Data.size() < DATA_HEADER)
+      return nullptr;
+
+   memcpy(&Expires, Data.data(), sizeof(Expires));
+   if (Expires != 0 && Expires <= (int64_t) time(nullptr))
+      return nullptr;
+
+   Value      = Data.c_str() + DATA_HEADER;
+   ExpiresStr = Value + strlen(Value) + 1;
+   SameSite   = ExpiresStr + strlen(ExpiresStr) + 1;
+
+   C = new CookieC();
+   C->SetName(Name);
+   C->SetValue(Value);
+   C->SetDomain(Domain);
+   if (Path)
+      C->SetPath(Path);
+   if (Data[8] & DATA_HAS_EXPIRES)
+      C->SetExpires(ExpiresStr);
+   if (Data[8] & DATA_HAS_SAMESITE)
+      C->SetSameSite(SameSite);
+   C->SetSecure((Flags & FLAG_SECURE) != 0);
+   C->SetHttpOnly((Flags & FLAG_HTTPONLY) != 0);
+
+   return C;
+}
+
+/*=****************************************************************************
+**
+** size_t SharedCookieStoreC::Count() const
+**
+** DESCRIPTION : Number of stored cookies, including expired ones not
+**    swept yet
+**
+** RETURN VALUE:
+**                                                                           */
+/*=***************************************************************************/
+size_t SharedCookieStoreC::Count() const
+{
+   return Header()->RecordCount.load(std::memory_order_relaxed);
+}
+
+/*=****************************************************************************
+**
+** size_t SharedCookieStoreC::BytesUsed() const
+**
+** DESCRIPTION : High-water mark of the segment, including free blocks
+**
+** RETURN VALUE:
+**                                                                           */
+/*=***************************************************************************/
+size_t SharedCookieStoreC::BytesUsed() const
+{
+   return Header()->AllocOffset.load(std::memory_order_relaxed);
+}
+
+/*=****************************************************************************
+**
+** size_t SharedCookieStoreC::BytesFree() const
+**
+** DESCRIPTION : Bytes held on the free lists, available for reuse
+**
+** RETURN VALUE:
+**                                                                           */
+/*=***************************************************************************/
+size_t SharedCookieStoreC::BytesFree() const
+{
+   return (size_t) Header()->FreeBytes.load(std::memory_order_relaxed);
+}
+
+#endif // _WIN32
+
+
+/*=****************************************************************************
+**
+** Traffic replay
+**
+** DESCRIPTION : "Cookie --replay <file>" replays captured Set-Cookie and
+**    Cookie headers through the parser to benchmark production-shaped
+**    load. <file> is a HAR capture or a raw header dump with one
+**    "Set-Cookie: ..." or "Cookie: ..." line per header; other lines are
+**    ignored.
+**
+**    Set-Cookie headers go through CookieC::FromString and ToString,
+**    Cookie request headers are split into pairs and each pair parsed
+**    with FromString.
+**
+**    The harness itself keeps a constant footprint while replaying
+**    (latencies go into fixed-size histograms), and RSS is reported
+**    relative to a baseline taken once the capture is loaded, so the
+**    figures reflect the library and compare across versions.
+**                                                                           */
+/*=***************************************************************************/
+struct ReplayItemS
+{
+   bool        IsSetCookie;
+   std::string Value;
+};
+
+struct ReplayOptionsS
+{
+   const char *FileName   = nullptr;
+   int         Threads    = 1;
+   double      Rate       = 0; // total ops/s, 0 = as fast as possible
+   int         Iterations = 1;
+};
+
+/*=****************************************************************************
+**
+** class ReplayHistogramC
+**
+** DESCRIPTION : Log-bucketed latency histogram of fixed size (about 8 KB).
+**    Each power of two is split into 16 linear sub-buckets, so recorded
+**    values are kept within 1/16 (6.25%) of their true value.
+**                                                                           */
+/*=***************************************************************************/
+class ReplayHistogramC
+{
+ public:
+   void     Record(uint64_t Value);
+   void     Merge(const ReplayHistogramC &Other);
+   uint64_t Count() const;
+   uint64_t Max() const;
+   uint64_t Percentile(double P) const;
+
+ private:
+   enum
+   {
+      SUB_BITS    = 4,
+      SUB_BUCKETS = 1 << SUB_BITS,
+      BUCKETS     = (64 - SUB_BITS + 1) * SUB_BUCKETS
+   };
+
+   static size_t   Index(uint64_t Value);
+   static uint64_t Midpoint(size_t Index);
+
+   uint64_t mCounts[BUCKETS] = {};
+   uint64_t mCount           = 0;
+   uint64_t mMax             = 0;
+};
+
+/*=****************************************************************************
+**
+** size_t ReplayHistogramC::Index(uint64_t Value)
+**
+** DESCRIPTION : Bucket of <Value>: values below SUB_BUCKETS map to
+**    themselves, larger ones to (power of two, top SUB_BITS below the
+**    leading bit)
+**
+** RETURN VALUE:
+**                                                                           */
+/*=***************************************************************************/
+size_t ReplayHistogramC::Index(uint64_t Value)
+{
+   int Shift;
+
+   if (Value < SUB_BUCKETS)
+      return (size_t) Value;
+
+   Shift = std::bit_width(Value) - 1 - SUB_BITS;
+   return (size_t) (Shift + 1) * SUB_BUCKETS + (size_t) ((Value >> Shift) & (SUB_BUCKETS - 1));
+}
+
+/*=****************************************************************************
+**
+** uint64_t ReplayHistogramC::Midpoint(size_t Index)
+**
+** DESCRIPTION : Middle of the value range of bucket <Index>
+**
+** RETURN VALUE:
+**                                                                           */
+/*=***************************************************************************/
+uint64_t ReplayHistogramC::Midpoint(size_t Index)
+{
+   int      Shift;
+   uint64_t Low;
+
+   if (Index < SUB_BUCKETS)
+      return Index;
+
+   Shift = (int) (Index / SUB_BUCKETS) - 1;
+   Low   = (uint64_t) (SUB_BUCKETS + Index % SUB_BUCKETS) << Shift;
+   return Low + (((uint64_t) 1 << Shift) >> 1);
+}
+
+/*=****************************************************************************
+**
+** void ReplayHistogramC::Record(uint64_t Value)
+**
+** DESCRIPTION :
+**
+** RETURN VALUE:
+**                                                                           */
+/*=***************************************************************************/
+void ReplayHistogramC::Record(uint64_t Value)
+{
+   mCounts[Index(Value)]++;
+   mCount++;
+   mMax = std::max(mMax, Value);
+}
+
+/*=****************************************************************************
+**
+** void ReplayHistogramC::Merge(const ReplayHistogramC &Other)
+**
+** DESCRIPTION :
+**
+** RETURN VALUE:
+**                                                                           */
+/*=***************************************************************************/
+void ReplayHistogramC::Merge(const ReplayHistogramC &Other)
+{
+   for (size_t i = 0; i < BUCKETS; i++)
+      mCounts[i] += Other.mCounts[i];
+   mCount += Other.mCount;
+   mMax = std::max(mMax, Other.mMax);
+}
+
+uint64_t ReplayHistogramC::Count() const
+{
+   return mCount;
+}
+
+uint64_t ReplayHistogramC::Max() const
+{
+   return mMax;
+}
+
+/*=****************************************************************************
+**
+** uint64_t ReplayHistogramC::Percentile(double P) const
+**
+** DESCRIPTION : Value below which a fraction <P> (0..1) of the recorded
+**    values fall, to bucket precision and never above Max()
+**
+** RETURN VALUE: 0 if nothing was recorded
+**                                                                           */
+/*=***************************************************************************/
+uint64_t ReplayHistogramC::Percentile(double P) const
+{
+   uint64_t Rank;
+   uint64_t Seen = 0;
+
+   if (mCount == 0)
+      return 0;
+
+   Rank = std::min(mCount - 1, (uint64_t) (P * mCount));
+
+   for (size_t i = 0; i < BUCKETS; i++)
+   {
+      Seen += mCounts[i];
+      if (Seen > Rank)
+         return std::min(Midpoint(i), mMax);
+   }
+   return mMax;
+}
+
+/*=****************************************************************************
+**
+** static void AddReplayHeader(std::vector<ReplayItemS> &Items, const
+**    std::string &Name, const std::string &Value)
+**
+** DESCRIPTION : Queue a Set-Cookie or Cookie header, one item per cookie
+**    for Set-Cookie values holding several lines
+**
+** RETURN VALUE:
+**                                                                           */
+/*=***************************************************************************/
+static void AddReplayHeader(std::vector<ReplayItemS> &Items, const std::string &Name, const std::string &Value)
+{
+   if (StrCaseEq(Name.c_str(), "Set-Cookie"))
+   {
+      size_t Pos = 0;
+
+      // browsers' HAR exports join repeated Set-Cookie headers with '\n'
+      while (Pos <= Value.size())
+      {
+         size_t End = Value.find('\n', Pos);
+
+         if (End == std::string::npos)
+            End = Value.size();
+
+         std::string Cookie = Value.substr(Pos, End - Pos);
+         Pos                = End + 1;
+
+         if (!Cookie.empty() && Cookie.back() == '\r')
+            Cookie.pop_back();
+         if (!Cookie.empty())
+            Items.push_back({true, std::move(Cookie)});
+      }
+   }
+   else if (StrCaseEq(Name.c_str(), "Cookie"))
+      Items.push_back({false, Value});
+}
+
+/*=****************************************************************************
+**
+** static bool ReadJsonString(const std::string &Text, size_t &Pos,
+**    std::string &Out)
+**
+** DESCRIPTION : Decode the JSON string starting at the '"' at <Pos>.
+**    \uXXXX escapes outside ASCII are replaced by '?', which is enough for
+**    header names and cookie values.
+**
+** RETURN VALUE: false if the string is not terminated, <Pos> is left after
+**    the closing quote
+**                                                                           */
+/*=***************************************************************************/
+static bool ReadJsonString(const std::string &Text, size_t &Pos, std::string &Out)
+{
+   Out.clear();
+   for (Pos++; Pos < Text.size(); Pos++)
+   {
+      char Ch = Text[Pos];
+
+      if (Ch == '"')
+      {
+         Pos++;
+         return true;
+      }
+      if (Ch != '\\')
+      {
+         Out.push_back(Ch);
+         continue;
+      }
+
+      if (++Pos >= Text.size())
+         return false;
+      switch (Text[Pos])
+      {
+         case 'n':
+            Out.push_back('\n');
+            break;
+         case 'r':
+            Out.push_back('\r');
+            break;
+         case 't':
+            Out.push_back('\t');
+            break;
+         case 'b':
+         case 'f':
+            break;
+         case 'u':
+         {
+            unsigned Code = 0;
+
+            if (Pos + 4 >= Text.size() || sscanf(Text.c_str() + Pos + 1, "%4x", &Code) != 1)
+               return false;
+            Out.push_back(Code < 0x80 ? (char) Code : '?');
+            Pos += 4;
+            break;
+         }
+         default:
+            Out.push_back(Text[Pos]);
+            break;
+      }
+   }
+   return false;
+}
+
+/*=****************************************************************************
+**
+** static void ParseHar(const std::string &Text, std::vector<ReplayItemS>
+**    &Items)
+**
+** DESCRIPTION : Collect the Set-Cookie/Cookie entries of the "headers"
+**    arrays of a HAR file. Each header is a flat {"name": .., "value": ..}
+**    object, so it is enough to pair up the name and value found between
+**    one '{' and the next '}'.
+**
+** RETURN VALUE:
+**                                                                           */
+/*=***************************************************************************/
+static void ParseHar(const std::string &Text, std::vector<ReplayItemS> &Items)
+{
+   std::string Key, Str, Name, Value;
+   bool        HasName = false, HasValue = false;
+   size_t      Pos     = 0;
+
+   while (Pos < Text.size())
+   {
+      char Ch = Text[Pos];
+
+      if (Ch == '{' || Ch == '}')
+      {
+         if (Ch == '}' && HasName && HasValue)
+            AddReplayHeader(Items, Name, Value);
+         HasName = HasValue = false;
+         Pos++;
+         continue;
+      }
+      if (Ch != '"')
+      {
+         Pos++;
+         continue;
+      }
+
+      if (!ReadJsonString(Text, Pos, Key))
+         return;
+
+      // a key is followed by ':', skip to its value
+      while (Pos < Text.size() && isspace((unsigned char) Text[Pos]))
+         Pos++;
+      if (Pos >= Text.size() || Text[Pos] != ':')
+         continue;
+      Pos++;
+      while (Pos < Text.size() && isspace((unsigned char) Text[Pos]))
+         Pos++;
+      if (Pos >= Text.size() || Text[Pos] != '"')
+         continue;
+      if (!ReadJsonString(Text, Pos, Str))
+         return;
+
+      if (Key == "name")
+      {
+         Name    = Str;
+         HasName = true;
+      }
+      else if (Key == "value")
+      {
+         Value    = Str;
+         HasValue = true;
+      }
+   }
+}
+
+/*=****************************************************************************
+**
+** static void ParseHeaderDump(const std::string &Text,
+**    std::vector<ReplayItemS> &Items)
+**
+** DESCRIPTION : Collect "Set-Cookie:" and "Cookie:" lines of a raw dump
+**
+** RETURN VALUE:
+**                                                                           */
+/*=***************************************************************************/
+static void ParseHeaderDump(const std::string &Text, std::vector<ReplayItemS> &Items)
+{
+   size_t Pos = 0;
+
+   while (Pos < Text.size())
+   {
+      size_t End   = Text.find('\n', Pos);
+      size_t Colon;
+
+      if (End == std::string::npos)
+         End = Text.size();
+
+      std::string Line = Text.substr(Pos, End - Pos);
+      Pos              = End + 1;
+
+      if (!Line.empty() && Line.back() == '\r')
+         Line.pop_back();
+      Colon = Line.find(':');
+      if (Colon == std::string::npos)
+         continue;
+
+      size_t ValueStart = Line.find_first_not_of(" \t", Colon + 1);
+      AddReplayHeader(Items, Line.substr(0, Colon), ValueStart == std::string::npos ? "" : Line.substr(ValueStart));
+   }
+}
+
+/*=****************************************************************************
+**
+** static long ReadRssKiB(bool Peak)
+**
+** DESCRIPTION : Current (VmRSS) or peak (VmHWM) resident set size from
+**    /proc/self/status, falling back to getrusage() for the peak where
+**    there is no /proc
+**
+** RETURN VALUE: KiB, -1 if unknown
+**                                                                           */
+/*=***************************************************************************/
+static long ReadRssKiB(bool Peak)
+{
+   const char *Field = Peak ? "VmHWM:" : "VmRSS:";
+   long        KiB   = -1;
+   char        Line[256];
+   FILE       *File;
+
+   File = fopen("/proc/self/status", "r");
+   if (File)
+   {
+      while (KiB < 0 && fgets(Line, sizeof(Line), File))
+      {
+         if (strncmp(Line, Field, strlen(Field)) == 0)
+            KiB = atol(Line + strlen(Field));
+      }
+      fclose(File);
+   }
+
+#ifndef _WIN32
+   struct rusage Usage;
+
+   if (KiB < 0 && Peak && getrusage(RUSAGE_SELF, &Usage) == 0)
+      KiB = Usage.ru_maxrss;
+#endif
+   return KiB;
+}
+
+/*=****************************************************************************
+**
+** static bool ResetPeakRss()
+**
+** DESCRIPTION : Reset VmHWM to the current RSS (Linux >= 4.0), so the peak
+**    read afterwards excludes loading the capture
+**
+** RETURN VALUE: false if not supported
+**                                                                           */
+/*=***************************************************************************/
+static bool ResetPeakRss()
+{
+   FILE *File = fopen("/proc/self/clear_refs", "w");
+   bool  Ok;
+
+   if (!File)
+      return false;
+   Ok = (fputs("5", File) >= 0);
+   return (fclose(File) == 0) && Ok;
+}
+
+/*=****************************************************************************
+**
+** static void ReplayOne(const ReplayItemS &Item)
+**
+** DESCRIPTION : Run one captured header through the library
+**
+** RETURN VALUE:
+**                                                                           */
+/*=***************************************************************************/
+static void ReplayOne(const ReplayItemS &Item)
+{
+   if (Item.IsSetCookie)
+   {
+      CookieC Cookie;
+
+      if (Cookie.FromString(Item.Value.c_str()))
+         Cookie.ToString();
+   }
+   else
+   {
+      char **Pairs = nullptr;
+      int    Count = SplitStringIntoItems(Item.Value.c_str(), &Pairs, ";");
+
+      for (int i = 0; i < Count; i++)
+      {
+         CookieC Cookie;
+
+         Cookie.FromString(Pairs[i]);
+      }
+      FreeArgCV(Pairs, Count);
+   }
+}
+
+/*=****************************************************************************
+**
+** static int RunReplay(int argc, char *argv[])
+**
+** DESCRIPTION : Entry point of --replay.
+**
+**    Options: --threads N, --rate OPS_PER_SEC (total over all threads),
+**    --iterations N (passes over the capture).
+**
+**    The passes over the capture form one sequence of operations; thread i
+**    runs operations i, i + N, i + 2N, ..., so every thread gets the same
+**    number give or take one. With a rate, operation k is scheduled at
+**    k / rate seconds after the start, which spreads the threads evenly
+**    over time at exactly the requested total rate. Latency is measured
+**    from the scheduled start, so a stalled operation also counts against
+**    the ones queued behind it.
+**
+** RETURN VALUE: process exit code
+**                                                                           */
+/*=***************************************************************************/
+static int RunReplay(int argc, char *argv[])
+{
+   using ClockT = std::chrono::steady_clock;
+
+   ReplayOptionsS                Options;
+   std::vector<ReplayItemS>      Items;
+   std::vector<ReplayHistogramC> Latencies;
+   std::vector<std::thread>      Workers;
+   ReplayHistogramC              All;
+   std::string                   Text;
+   FILE                         *File;
+   char                          Buffer[65536];
+   size_t                        Len;
+   size_t                        SetCookies = 0;
+   uint64_t                      Total;
+   long                          BaselineRss;
+   long                          PeakRss;
+   bool                          PeakReset;
+   int                           i;
+
+   for (i = 0; i < argc; i++)
+   {
+      if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+         Options.Threads = atoi(argv[++i]);
+      else if (strcmp(argv[i], "--rate") == 0 && i + 1 < argc)
+         Options.Rate = atof(argv[++i]);
+      else if (strcmp(argv[i], "--iterations") == 0 && i + 1 < argc)
+         Options.Iterations = atoi(argv[++i]);
+      else if (!Options.FileName && argv[i][0] != '-')
+         Options.FileName = argv[i];
+      else
+      {
+         Options.FileName = nullptr;
+         break;
+      }
+   }
+   if (!Options.FileName || Options.Threads < 1 || Options.Iterations < 1 || Options.Rate < 0)
+   {
+      fprintf(stderr, "usage: --replay <har or header dump> [--threads N] [--rate OPS_PER_SEC] [--iterations N]\n");
+      return 2;
+   }
+
+   File = fopen(Options.FileName, "rb");
+   if (!File)
+   {
+      fprintf(stderr, "cannot open %s\n", Options.FileName);
+      return 1;
+   }
+   while ((Len = fread(Buffer, 1, sizeof(Buffer), File)) > 0)
+      Text.append(Buffer, Len);
+   fclose(File);
+
+   size_t First = Text.find_first_not_of(" \t\r\n");
+   if (First != std::string::npos && Text[First] == '{')
+      ParseHar(Text, Items);
+   else
+      ParseHeaderDump(Text, Items);
+   Text.clear();
+   Text.shrink_to_fit();
+
+   if (Items.empty())
+   {
+      fprintf(stderr, "no Set-Cookie or Cookie headers in %s\n", Options.FileName);
+      return 1;
+   }
+   for (const ReplayItemS &Item : Items)
+      SetCookies += Item.IsSetCookie;
+
+   Latencies.resize(Options.Threads);
+   Items.shrink_to_fit();
+   Total = (uint64_t) Items.size() * (uint64_t) Options.Iterations;
+   PeakReset   = ResetPeakRss();
+   BaselineRss = ReadRssKiB(PeakReset);
+   ClockT::time_point Start = ClockT::now();
+
+   for (i = 0; i < Options.Threads; i++)
+   {
+      Workers.emplace_back([&, i]() {
+         ReplayHistogramC &Lat = Latencies[i];
+
+         for (uint64_t Op = i; Op < Total; Op += Options.Threads)
+         {
+            ClockT::time_point OpStart;
+
+            if (Options.Rate > 0)
+            {
+               // from the operation number, so rounding does not drift
+               OpStart = Start + std::chrono::duration_cast<ClockT::duration>(
+                                    std::chrono::duration<double>(Op / Options.Rate));
+               std::this_thread::sleep_until(OpStart);
+            }
+            else
+               OpStart = ClockT::now();
+
+            ReplayOne(Items[Op % Items.size()]);
+            Lat.Record(
+               (uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(ClockT::now() - OpStart).count());
+         }
+      });
+   }
+   for (std::thread &Worker : Workers)
+      Worker.join();
+
+   double Seconds = std::chrono::duration<double>(ClockT::now() - Start).count();
+
+   PeakRss = ReadRssKiB(true);
+   for (const ReplayHistogramC &Lat : Latencies)
+      All.Merge(Lat);
+
+   printf("headers     : %zu (%zu Set-Cookie, %zu Cookie)\n", Items.size(), SetCookies, Items.size() - SetCookies);
+   printf("operations  : %llu in %.3f s, %d thread(s)\n", (unsigned long long) All.Count(), Seconds,
+          Options.Threads);
+   printf("throughput  : %.0f ops/s\n", All.Count() / Seconds);
+   printf("latency (us): p50 %.2f  p99 %.2f  p999 %.2f  max %.2f\n", All.Percentile(0.50) / 1000.0,
+          All.Percentile(0.99) / 1000.0, All.Percentile(0.999) / 1000.0, All.Max() / 1000.0);
+   if (BaselineRss >= 0 && PeakRss >= 0)
+   {
+      // without a peak reset the baseline is the peak of loading, which
+      // may hide growth below it
+      printf("RSS (KiB)   : baseline %ld after loading, peak +%ld while replaying%s\n", BaselineRss,
+             std::max(0L, PeakRss - BaselineRss), PeakReset ? "" : " (over the loading peak)");
+   }
+
+   return 0;
+}
+
+
+/*=****************************************************************************
+**
+** Self test
+**
+** DESCRIPTION : "Cookie --selftest" runs checks of the parts that are hard
+**    to get right by inspection (concurrency, binary formats). Each
+**    SelfTest* function reports failed checks with SelfTestCheck.
+**                                                                           */
+/*=***************************************************************************/
+static int SelfTestFailures = 0;
+
+static void SelfTestCheck(bool Ok, const char *What)
+{
+   if (!Ok)
+   {
+      printf("FAIL: %s\n", What);
+      SelfTestFailures++;
+   }
+}
+
+/*=****************************************************************************
+**
+** static void SelfTestBoundedParse()
+**
+** DESCRIPTION : Max-Age in the bounded parser: whitespace around the value
+**    is accepted, anything else that is not a number is rejected
+**
+** RETURN VALUE:
+**                                                                           */
+/*=***************************************************************************/
+static void SelfTestBoundedParse()
+{
+   CookieParseLimitsS Limits;
+   CookieParseResultE Result;
+   CookieC            Cookie;
+   time_t             Now = time(nullptr);
+
+   SelfTestCheck(Cookie.FromString("a=1; max-age= 50", nullptr, Limits, &Result) && Result == COOKIE_PARSE_OK &&
+                     Cookie.GetExpiresTime() >= Now + 50,
+                 "bounded parse: space before Max-Age");
+   SelfTestCheck(Cookie.FromString("a=1; max-age=50\t ", nullptr, Limits, &Result) && Result == COOKIE_PARSE_OK,
+                 "bounded parse: space after Max-Age");
+   SelfTestCheck(!Cookie.FromString("a=1; max-age=5 0", nullptr, Limits, &Result) && Result == COOKIE_PARSE_BAD_MAX_AGE,
+                 "bounded parse: space inside Max-Age");
+   SelfTestCheck(!Cookie.FromString("a=1; max-age= ", nullptr, Limits, &Result) && Result == COOKIE_PARSE_BAD_MAX_AGE,
+                 "bounded parse: blank Max-Age");
+}
+
+/*=****************************************************************************
+**
+** static void SelfTestPublicSuffixList()
+**
+** DESCRIPTION : Internationalized rules loaded at run time match punycode
+**    hosts, and IP literals are never split at a public suffix
+**
+** RETURN VALUE:
+**                                                                           */
+/*=***************************************************************************/
+static void SelfTestPublicSuffixList()
+{
+   PublicSuffixListC Psl;
+   const char       *Domain;
+
+   Psl.LoadString("// comment\n\xe5\x85\xac\xe5\x8f\xb8.cn\n*.b\xc3\xbc\x63her.example\nbad\xff.cn\n");
+   Domain = Psl.RegistrableDomain("b.a.xn--55qx5d.cn");
+   SelfTestCheck(Domain && strcmp(Domain, "a.xn--55qx5d.cn") == 0, "public suffix list: UTF-8 rule loaded as punycode");
+   Domain = Psl.RegistrableDomain("a.b.c.xn--bcher-kva.example");
+   SelfTestCheck(Domain && strcmp(Domain, "b.c.xn--bcher-kva.example") == 0,
+                 "public suffix list: mixed ASCII/UTF-8 wildcard rule");
+   SelfTestCheck(!Psl.IsPublicSuffix("bad\xff.cn"), "public suffix list: invalid UTF-8 rule skipped");
+
+   Domain = PublicSuffixListC::Default().RegistrableDomain("192.168.0.1");
+   SelfTestCheck(Domain && strcmp(Domain, "192.168.0.1") == 0, "public suffix list: IPv4 literal kept whole");
+   Domain = PublicSuffixListC::Default().RegistrableDomain("[2001:db8::1]");
+   SelfTestCheck(Domain && strcmp(Domain, "[2001:db8::1]") == 0, "public suffix list: IPv6 literal kept whole");
+   SelfTestCheck(!PublicSuffixListC::IsIpLiteral("1.2.3.256") && !PublicSuffixListC::IsIpLiteral("1.2.3"),
+                 "public suffix list: not an IPv4 literal");
+
+   CookieJarC Jar;
+   CookieC    Cookie;
+
+   Cookie.FromString("a=1; Domain=192.168.0.1");
+   Jar.Set(Cookie);
+   Cookie.FromString("b=1; Domain=10.0.0.1");
+   Jar.Set(Cookie);
+   SelfTestCheck(Jar.CountForDomain("192.168.0.1") == 1, "cookie jar: IP literals are separate domains");
+}
+
+/*=****************************************************************************
+**
+** static void SelfTestCookieJarHost()
+**
+** DESCRIPTION : FindForHost skips expired cookies and counts as a use for
+**    the LRU eviction
+**
+** RETURN VALUE:
+**                                                                           */
+/*=***************************************************************************/
+static void SelfTestCookieJarHost()
+{
+   CookieJarLimitsS             Limits;
+   std::vector<const CookieC *> Found;
+   CookieC                      Cookie;
+
+   Limits.MaxCookies = 2;
+   CookieJarC Jar(Limits);
+
+   Cookie.FromString("a=1; Domain=x.example.com");
+   Jar.Set(Cookie);
+   Cookie.FromString("b=1; Domain=y.example.org");
+   Jar.Set(Cookie);
+   SelfTestCheck(Jar.FindForHost("x.example.com", Found) == 1, "cookie jar: find for host");
+   Cookie.FromString("c=1; Domain=z.example.net");
+   Jar.Set(Cookie);
+   SelfTestCheck(Jar.Find("a", "x.example.com", "/") != nullptr, "cookie jar: found cookie kept by LRU");
+   SelfTestCheck(Jar.Find("b", "y.example.org", "/") == nullptr, "cookie jar: unused cookie evicted by LRU");
+
+   CookieJarC Expiring;
+
+   Cookie.FromString("c=1; Domain=z.example.net");
+   Expiring.Set(Cookie);
+   Cookie.FromString("d=1; Domain=z.example.net; Max-Age=1");
+   Expiring.Set(Cookie);
+   std::this_thread::sleep_for(std::chrono::seconds(2));
+   Found.clear();
+   SelfTestCheck(Expiring.FindForHost("z.example.net", Found) == 1 && strcmp(Found[0]->GetName(), "c") == 0,
+                 "cookie jar: expired cookie not found for host");
+}
+
+/*=****************************************************************************
+**
+** static void SelfTestDeltaSet(std::vector<unsigned char> &Delta, const
+**    char *Value, uint64_t Creation)
+**
+** DESCRIPTION : Hand-encode a one record delta setting "t=<Value>" on
+**    example.com with a given creation time, which Set() cannot produce
+**
+** RETURN VALUE:
+**                                                                           */
+/*=***************************************************************************/
+static void SelfTestDeltaSet(std::vector<unsigned char> &Delta, const char *Value, uint64_t Creation)
+{
+   auto PutVarint = [&Delta](uint64_t Number) {
+      for (; Number >= 0x80; Number >>= 7)
+         Delta.push_back((unsigned char) (Number | 0x80));
+      Delta.push_back((unsigned char) Number);
+   };
+   auto PutString = [&Delta, &PutVarint](const char *Str) {
+      PutVarint(strlen(Str));
+      Delta.insert(Delta.end(), Str, Str + strlen(Str));
+   };
+
+   Delta.assign({'C', 'K', 'D', '1'});
+   PutVarint(0);        // since
+   PutVarint(1);        // sequence
+   PutVarint(1);        // records
+   Delta.push_back(1);  // DELTA_SET
+   PutString("t");
+   PutString("example.com");
+   PutString("");
+   PutVarint(Creation);
+   Delta.push_back(0);  // flags
+   PutVarint(0);        // session cookie
+   PutString(Value);
+   PutString("");
+}
+
+/*=****************************************************************************
+**
+** static void SelfTestCookieJarDelta()
+**
+** DESCRIPTION : ExportDelta/ApplyDelta round trip, truncated deltas,
+**    convergence of conflicting sets, and the cap on remembered deletions
+**
+** RETURN VALUE:
+**                                                                           */
+/*=***************************************************************************/
+static void SelfTestCookieJarDelta()
+{
+   std::vector<unsigned char> Delta;
+   std::vector<unsigned char> Delta2;
+   CookieJarC                 Sender;
+   CookieJarC                 Receiver;
+   const CookieC             *Found;
+   uint64_t                   Synced = 0;
+   bool                       AllRejected;
+
+   // FromString keeps attributes of a previous parse, so one CookieC each
+   auto SetCookie = [](CookieJarC &Jar, const char *Str) {
+      CookieC Cookie;
+
+      Cookie.FromString(Str);
+      return Jar.Set(Cookie);
+   };
+
+   // round trip: a full snapshot, then an incremental delta with a removal
+   SetCookie(Sender, "a=1; Domain=example.com; Path=/x; Secure; HttpOnly; SameSite=Strict; Max-Age=3600");
+   SetCookie(Sender, "b=2; Domain=www.example.com");
+   Sender.ExportDelta(0, Delta);
+   SelfTestCheck(Receiver.ApplyDelta(Delta.data(), Delta.size(), &Synced) == 2 && Synced == Sender.GetSequence(),
+                 "cookie jar delta: apply snapshot");
+   Found = Receiver.Find("a", "example.com", "/x");
+   SelfTestCheck(Found && strcmp(Found->GetValue(), "1") == 0 && Found->IsSecure() && Found->IsHttpOnly() &&
+                    Found->GetSameSite() && StrCaseEq(Found->GetSameSite(), "Strict") &&
+                    Found->GetExpiresTime() == Sender.Find("a", "example.com", "/x")->GetExpiresTime(),
+                 "cookie jar delta: attributes survive the round trip");
+
+   Sender.Remove("a", "example.com", "/x");
+   SetCookie(Sender, "c=3; Domain=example.com");
+   SelfTestCheck(Sender.ExportDelta(Synced, Delta) == 2, "cookie jar delta: incremental export");
+   SelfTestCheck(Receiver.ApplyDelta(Delta.data(), Delta.size(), &Synced) == 2 && Receiver.Count() == 2 &&
+                    !Receiver.Find("a", "example.com", "/x") && Receiver.Find("c", "example.com", nullptr),
+                 "cookie jar delta: apply incremental delta");
+
+   // every truncation of a valid delta is rejected and changes nothing
+   Sender.ExportDelta(0, Delta);
+   uint64_t Sequence = Receiver.GetSequence();
+   AllRejected       = true;
+   for (size_t Len = 0; Len < Delta.size(); Len++)
+      AllRejected = AllRejected && Receiver.ApplyDelta(Delta.data(), Len) == -1;
+   SelfTestCheck(AllRejected && Receiver.Count() == 2 && Receiver.GetSequence() == Sequence,
+                 "cookie jar delta: truncated delta rejected");
+
+   // conflicting sets with the same creation time converge in either order
+   CookieJarC Replica1;
+   CookieJarC Replica2;
+   uint64_t   Creation = (uint64_t) time(nullptr);
+
+   SelfTestDeltaSet(Delta, "red", Creation);
+   SelfTestDeltaSet(Delta2, "blue", Creation);
+   Replica1.ApplyDelta(Delta.data(), Delta.size());
+   Replica1.ApplyDelta(Delta2.data(), Delta2.size());
+   Replica2.ApplyDelta(Delta2.data(), Delta2.size());
+   Replica2.ApplyDelta(Delta.data(), Delta.size());
+   const CookieC *Value1 = Replica1.Find("t", "example.com", nullptr);
+   const CookieC *Value2 = Replica2.Find("t", "example.com", nullptr);
+   SelfTestCheck(Value1 && Value2 && strcmp(Value1->GetValue(), Value2->GetValue()) == 0,
+                 "cookie jar delta: tie-break converges");
+
+   // deletions beyond MaxCookies are forgotten, oldest first
+   CookieJarLimitsS Limits;
+   char             Name[64];
+
+   Limits.MaxCookies = 4;
+   CookieJarC Capped(Limits);
+   for (int i = 0; i < 10; i++)
+   {
+      snprintf(Name, sizeof(Name), "n%d=1; Domain=example.com", i);
+      SetCookie(Capped, Name);
+      snprintf(Name, sizeof(Name), "n%d", i);
+      Capped.Remove(Name, "example.com", nullptr);
+   }
+   SelfTestCheck(Capped.ExportDelta(0, Delta) == 4 && Capped.GetForgottenSequence() > 0 &&
+                    Capped.GetForgottenSequence() < Capped.GetSequence(),
+                 "cookie jar delta: remembered deletions are capped");
+}
+
+#ifndef _WIN32
+/*=****************************************************************************
+**
+** static void SelfTestSharedStore()
+**
+** DESCRIPTION : Several processes write the same keys concurrently while
+**    churning through unique keys that are set and deleted, in a segment
+**    far too small to hold them all unless space is reclaimed; then check
+**    expiry handling.
+**
+** RETURN VALUE:
+**                                                                           */
+/*=***************************************************************************/
+static void SelfTestSharedStore()
+{
+   const int           WORKERS    = 4;
+   const int           ITERATIONS = 20000;
+   const int           SHARED     = 64;
+   char                ShmName[64];
+   char                Str[128];
+   SharedCookieStoreC *Store;
+   CookieC            *Got;
+   int                 Status;
+   bool                AllOk = true;
+
+   snprintf(ShmName, sizeof(ShmName), "/cookie-selftest-%d", (int) getpid());
+   SharedCookieStoreC::Unlink(ShmName);
+   Store = SharedCookieStoreC::Create(ShmName, 256 * 1024, 256);
+   SelfTestCheck(Store != nullptr, "shared store: create");
+   if (!Store)
+      return;
+
+   for (int w = 0; w < WORKERS; w++)
+   {
+      if (fork() != 0)
+         continue;
+
+      SharedCookieStoreC *Worker = SharedCookieStoreC::Open(ShmName);
+      int                 Code   = Worker ? 0 : 1;
+
+      for (int i = 0; i < ITERATIONS && Code == 0; i++)
+      {
+         CookieC Shared, Unique, Removal;
+
+         snprintf(Str, sizeof(Str), "k%d=w%d_%d; domain=example.com; path=/; Max-Age=100", i % SHARED, w, i);
+         Shared.FromString(Str);
+         if (!Worker->Set(Shared))
+            Code = 2;
+
+         snprintf(Str, sizeof(Str), "u%d_%d=%d; domain=example.com", w, i, i);
+         Unique.FromString(Str);
+         if (!Worker->Set(Unique))
+            Code = 3;
+         Got = Worker->Get(Unique.GetName(), "example.com", nullptr);
+         if (!Got || strcmp(Got->GetValue(), Unique.GetValue()) != 0)
+            Code = 4;
+         delete Got;
+
+         snprintf(Str, sizeof(Str), "u%d_%d=x; domain=example.com; expires=Wed, 21 Oct 2020 07:28:00 GMT", w, i);
+         Removal.FromString(Str);
+         Worker->Set(Removal);
+
+         Got = Worker->Get(Shared.GetName(), "example.com", "/");
+         if (!Got || Got->GetValue()[0] != 'w')
+            Code = 5;
+         delete Got;
+      }
+      delete Worker;
+      _exit(Code);
+   }
+   while (wait(&Status) > 0)
+      AllOk = AllOk && WIFEXITED(Status) && WEXITSTATUS(Status) == 0;
+
+   SelfTestCheck(AllOk, "shared store: concurrent workers");
+   SelfTestCheck(Store->Count() == (size_t) SHARED, "shared store: count after churn");
+   for (int k = 0; k < SHARED; k++)
+   {
+      snprintf(Str, sizeof(Str), "k%d", k);
+      Got = Store->Get(Str, "example.com", "/");
+      SelfTestCheck(Got != nullptr, "shared store: shared key survives");
+      delete Got;
+   }
+
+   CookieC Unparsable, Short;
+
+   Unparsable.FromString("k0=y; domain=example.com; path=/; expires=2030-01-01");
+   Store->Set(Unparsable);
+   Got = Store->Get("k0", "example.com", "/");
+   SelfTestCheck(Got && strcmp(Got->GetValue(), "y") == 0, "shared store: unparsable Expires is ignored");
+   delete Got;
+
+   Short.FromString("short=1; domain=example.com; Max-Age=1");
+   SelfTestCheck(Store->Set(Short), "shared store: set short-lived");
+   sleep(2);
+   Got = Store->Get("short", "example.com", nullptr);
+   SelfTestCheck(Got == nullptr, "shared store: expired cookie not returned");
+   delete Got;
+   SelfTestCheck(Store->PurgeExpired(time(nullptr)) == 1, "shared store: sweep frees expired cookie");
+   SelfTestCheck(Store->Count() == (size_t) SHARED, "shared store: count after sweep");
+
+   delete Store;
+   SharedCookieStoreC::Unlink(ShmName);
+}
+#endif // _WIN32
+
+/*=****************************************************************************
+**
+** static int RunSelfTest()
+**
+** DESCRIPTION : Entry point of --selftest
+**
+** RETURN VALUE: process exit code
+**                                                                           */
+/*=***************************************************************************/
+static int RunSelfTest()
+{
+   SelfTestBoundedParse();
+   SelfTestPublicSuffixList();
+   SelfTestCookieJarHost();
+   SelfTestCookieJarDelta();
+#ifndef _WIN32
+   SelfTestSharedStore();
+#endif
+
+   printf("%s\n", SelfTestFailures ? "self test FAILED" : "self test passed");
+   return SelfTestFailures ? 1 : 0;
+}
+
+
+
+int main(int argc, char* argv[])
+{
+    if (argc > 1 && strcmp(argv[1], "--replay") == 0)
+        return RunReplay(argc - 2, argv + 2);
+    if (argc > 1 && strcmp(argv[1], "--selftest") == 0)
+        return RunSelfTest();
+
     // Example usage
     const char* CookieStr = "name=value; domain=example.com; path=/; expires=Wed, 21 Oct 2023 07:28:00 GMT; secure; httponly";
     CookieC* Cookie = new CookieC();
@@ -0,0 +1,78 @@
+#!/usr/bin/env python3
+"""Generate public_suffix_list.inc from a public_suffix_list.dat file.
+
+Usage: gen_public_suffix_list.py public_suffix_list.dat [SNAPSHOT_DATE]
+
+Writes public_suffix_list.inc next to this script. SNAPSHOT_DATE
+(YYYY-MM-DD) defaults to the modification date of the .dat file.
+
+Every rule of the ICANN and private sections is kept; comments are
+dropped. Internationalized labels are converted to punycode ("xn--")
+labels, the same conversion PublicSuffixListC::LoadString applies, so the
+built-in list and a list loaded at run time match the same hosts.
+"""
+
+import datetime
+import os
+import sys
+
+HEADER = """\
+// Rules of public_suffix_list.dat (https://publicsuffix.org, {date}
+// snapshot), ICANN and private sections. Comments are dropped and
+// internationalized rules are converted to punycode ("xn--") labels, the
+// form hosts and cookie domains take on the wire.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at https://mozilla.org/MPL/2.0/.
+"""
+
+
+def to_ascii(label):
+    if label.isascii():
+        return label.lower()
+    return "xn--" + label.lower().encode("punycode").decode("ascii")
+
+
+def read_rules(path):
+    rules = []
+    seen = set()
+    with open(path, encoding="utf-8") as dat:
+        for line in dat:
+            words = line.split()
+            if not words or words[0].startswith("//"):
+                continue
+            rule = words[0]
+            prefix = ""
+            if rule.startswith("!"):
+                prefix, rule = "!", rule[1:]
+            rule = prefix + ".".join(to_ascii(label) for label in rule.split("."))
+            if rule not in seen:
+                seen.add(rule)
+                rules.append(rule)
+    return rules
+
+
+def main(argv):
+    if len(argv) not in (2, 3):
+        sys.stderr.write(__doc__)
+        return 2
+
+    if len(argv) == 3:
+        date = argv[2]
+    else:
+        date = datetime.datetime.fromtimestamp(os.path.getmtime(argv[1]), datetime.timezone.utc).strftime("%Y-%m-%d")
+
+    rules = read_rules(argv[1])
+    out = os.path.join(os.path.dirname(os.path.abspath(__file__)), "public_suffix_list.inc")
+    with open(out, "w", encoding="ascii", newline="\n") as inc:
+        inc.write(HEADER.format(date=date))
+        inc.write("\n")
+        for rule in rules:
+            inc.write('"%s",\n' % rule)
+    print("%s: %d rules" % (out, len(rules)))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))